@@ -0,0 +1,6 @@
+sim -sweep sweeps/assoc.sweep -store results.csv -export cc_assoc.csv traces/cc.trace
+sim -sweep sweeps/assoc.sweep -store results.csv -export spice_assoc.csv traces/spice.trace
+sim -sweep sweeps/assoc.sweep -store results.csv -export tex_assoc.csv traces/tex.trace
+sim -sweep sweeps/block_size.sweep -store results.csv -export cc_block_size.csv traces/cc.trace
+sim -sweep sweeps/block_size.sweep -store results.csv -export spice_block_size.csv traces/spice.trace
+sim -sweep sweeps/block_size.sweep -store results.csv -export tex_block_size.csv traces/tex.trace
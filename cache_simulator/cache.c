@@ -4,32 +4,131 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "cache.h"
 #include "main.h"
+#include "trace.h"
+#include "prof.h"
 
 /* cache configuration parameters */
-static int cache_split = 0;
-static int cache_usize = DEFAULT_CACHE_SIZE;
-static int cache_isize = DEFAULT_CACHE_SIZE;
-static int cache_dsize = DEFAULT_CACHE_SIZE;
-static int cache_block_size = DEFAULT_CACHE_BLOCK_SIZE;
-static int words_per_block = DEFAULT_CACHE_BLOCK_SIZE / WORD_SIZE;
-static int cache_assoc = DEFAULT_CACHE_ASSOC;
-static int cache_writeback = DEFAULT_CACHE_WRITEBACK;
-static int cache_writealloc = DEFAULT_CACHE_WRITEALLOC;
+static SIM_TLS int cache_split = 0;
+static SIM_TLS int cache_usize = DEFAULT_CACHE_SIZE;
+static SIM_TLS int cache_isize = DEFAULT_CACHE_SIZE;
+static SIM_TLS int cache_dsize = DEFAULT_CACHE_SIZE;
+static SIM_TLS int cache_block_size = DEFAULT_CACHE_BLOCK_SIZE;
+static SIM_TLS int words_per_block = DEFAULT_CACHE_BLOCK_SIZE / WORD_SIZE;
+static SIM_TLS int cache_assoc = DEFAULT_CACHE_ASSOC;
+static SIM_TLS int cache_writeback = DEFAULT_CACHE_WRITEBACK;
+static SIM_TLS int cache_writealloc = DEFAULT_CACHE_WRITEALLOC;
+static SIM_TLS int cache_mshrs = DEFAULT_CACHE_MSHRS;
+static SIM_TLS int cache_fill_latency = DEFAULT_CACHE_FILL_LATENCY;
+static SIM_TLS int cache_index_hash = INDEX_HASH_PLAIN;
+static SIM_TLS int cache_sector_size = 0;	/* 0 = one sector per block */
+static SIM_TLS int cache_emit = FALSE;		/* write the miss stream to a derived trace */
+
+/* sector geometry, derived in init_cache */
+static SIM_TLS int cache_sectors = 1;		/* sectors per block */
+static SIM_TLS int cache_sector_words = DEFAULT_CACHE_BLOCK_SIZE / WORD_SIZE;
+static SIM_TLS int cache_sector_offset;		/* log2 of the sector size */
 
 /* cache model data structures */
-static Pcache icache;
-static Pcache dcache;
-static cache c1;
-static cache c2;
-static cache_stat cache_stat_inst;
-static cache_stat cache_stat_data;
+static SIM_TLS Pcache icache;
+static SIM_TLS Pcache dcache;
+static SIM_TLS cache c1;
+static SIM_TLS cache c2;
+static SIM_TLS cache_stat cache_stat_inst;
+static SIM_TLS cache_stat cache_stat_data;
+
+/* write buffer between the cache and memory for written-through stores */
+static SIM_TLS int cache_wbuf_entries = 0;	/* 0 = stores go straight to memory */
+static SIM_TLS int cache_wbuf_drain = DEFAULT_WBUF_DRAIN;
+static SIM_TLS int cache_wbuf_bypass = FALSE;
+static SIM_TLS Pwbuf_entry wbuf;
+static SIM_TLS int wbuf_head;
+static SIM_TLS int wbuf_count;
+static SIM_TLS int wbuf_offset;			/* log2 of the bytes one entry covers */
+static SIM_TLS unsigned long long wbuf_drain_at;	/* cycle the head entry reaches memory */
+static SIM_TLS wbuf_stat wbuf_stats;
+
+/* co-running traces sharing the cache, one owner each */
+static SIM_TLS int cache_owners = 1;
+static SIM_TLS int cache_owner = 0;
+static SIM_TLS int cache_occ_interval = 0;	/* references between occupancy samples */
+static SIM_TLS Powner_stat owner_stats;
+static SIM_TLS int *occ_samples;		/* n_occ_samples rows of cache_owners */
+static SIM_TLS int n_occ_samples;
+static SIM_TLS int occ_samples_size;
+static SIM_TLS long long occ_refs;
+
+/* way partitioning, a way mask per class of service */
+static SIM_TLS int cache_partitioned = FALSE;
+static SIM_TLS int cache_class = 0;
+static SIM_TLS unsigned long long class_ways[MAX_CACHE_CLASSES];
+static SIM_TLS int class_configured[MAX_CACHE_CLASSES];
+static SIM_TLS cache_stat class_stats[MAX_CACHE_CLASSES];
+
+/* Belady OPT replacement, driven by the next use of each reference */
+static SIM_TLS int cache_opt = FALSE;
+static SIM_TLS unsigned long long cache_next_use;
+
+/* timing model state, only advanced when MSHRs are configured */
+static SIM_TLS unsigned long long cache_cycle;		/* current cycle, one per reference */
+static SIM_TLS unsigned long long mshr_busy_until;	/* cycle the last outstanding fill completes */
+static SIM_TLS double mshr_busy_cycles;		/* cycles with at least one fill outstanding */
+static SIM_TLS double mshr_fill_cycles;		/* sum of the latencies of all fills */
+
+/* the line and set the previous reference of each access type touched,
+   NULL once that line may no longer take a repeat as a plain MRU hit */
+static SIM_TLS Pcache_line repeat_line[TRACE_INST_LOAD + 1];
+static SIM_TLS Pcache_set repeat_set[TRACE_INST_LOAD + 1];
+
+/* conflict hotspots, counted per set and as a histogram of misses per
+   address region */
+static SIM_TLS int cache_region_size = 0;	/* 0 = no hotspot counters */
+static SIM_TLS Pset_stat hot_set;		/* counters of the set being referenced */
+static SIM_TLS Pset_stat repeat_stat[TRACE_INST_LOAD + 1];
+static SIM_TLS unsigned long long **region_dir;	/* chunks of region miss counts */
+static SIM_TLS int n_region_chunks;
 
 /************************************************************/
 void set_cache_param(param, value);
+void owner_evict(int owner);
+void emit_fill(Pcache_stat stat, unsigned addr);
+void sample_occupancy();
+
+/************************************************************/
+/* precompute the multiplier and shifts for dividing by divisor */
+void fastdiv_init(Pfastdiv d, unsigned divisor)
+{
+	int l = 0;
+
+	while ((1ull << l) < divisor)
+		l++;
+
+	d->divisor = divisor;
+	d->multiplier = (unsigned)((((1ull << l) - divisor) << 32) / divisor + 1);
+	d->shift1 = l < 1 ? l : 1;
+	d->shift2 = l < 1 ? 0 : l - 1;
+}
+/************************************************************/
+
+/************************************************************/
+unsigned fastdiv_div(Pfastdiv d, unsigned n)
+{
+	unsigned t = (unsigned)(((unsigned long long)n * d->multiplier) >> 32);
+
+	return (t + ((n - t) >> d->shift1)) >> d->shift2;
+}
+/************************************************************/
+
+/************************************************************/
+unsigned fastdiv_mod(Pfastdiv d, unsigned n)
+{
+	return n - fastdiv_div(d, n) * d->divisor;
+}
+/************************************************************/
 
 /* initialize one cache instance */
 void init_cache_instance(cache *c, int cache_size)
@@ -42,25 +141,117 @@ void init_cache_instance(cache *c, int cache_size)
 	c->associativity = cache_assoc;
 
 	// size of set.
+	if (cache_size % (cache_assoc * cache_block_size) || cache_size < cache_assoc * cache_block_size)
+	{
+		printf("error:  cache size %d is not a multiple of associativity * block size (%d)\n",
+			   cache_size, cache_assoc * cache_block_size);
+		exit(-1);
+	}
 	c->n_sets = cache_size / (cache_assoc * cache_block_size);
 
-	set_bits = LOG2(c->n_sets);
-	offset_bits = LOG2(cache_block_size);
+	// set_bits is rounded up, so it covers every set of a cache whose
+	// set count is not a power of two.
+	for (set_bits = 0; (1u << set_bits) < (unsigned)c->n_sets; set_bits++)
+		;
+	for (offset_bits = 0; (1 << offset_bits) < cache_block_size; offset_bits++)
+		;
 
 	mask = (1 << set_bits) - 1;
 
 	c->index_mask = mask << offset_bits;
 	c->index_mask_offset = offset_bits;
+	c->set_bits = set_bits;
+	c->pow2_sets = (c->n_sets & (c->n_sets - 1)) == 0;
+	fastdiv_init(&c->set_div, c->n_sets);
+
+	c->index_hash = cache_index_hash;
+	if (cache_index_hash == INDEX_HASH_PLAIN && !c->pow2_sets)
+		c->index_hash = INDEX_HASH_MODULO;
+	if (cache_index_hash == INDEX_HASH_PRIME)
+	{
+		// use the largest prime number of sets that fits
+		int p;
+		for (p = c->n_sets; p > 2; p--)
+		{
+			int d;
+			for (d = 2; d * d <= p && p % d; d++)
+				;
+			if (d * d > p)
+				break;
+		}
+		fastdiv_init(&c->set_div, p);
+	}
 
-	c->LRU_head = (Pcache_line *)malloc(sizeof(Pcache_line) * c->n_sets);
-	c->LRU_tail = (Pcache_line *)malloc(sizeof(Pcache_line) * c->n_sets);
-	memset(c->LRU_head, 0, c->n_sets * sizeof(Pcache_line));
-	memset(c->LRU_tail, 0, c->n_sets * sizeof(Pcache_line));
+	c->skew_lines = 0;
+	c->skew_clock = 0;
+	if (cache_index_hash == INDEX_HASH_SKEW)
+	{
+		c->skew_lines = (Pskew_line)malloc(sizeof(skew_line) * c->n_sets * c->associativity);
+		memset(c->skew_lines, 0, sizeof(skew_line) * c->n_sets * c->associativity);
+	}
 
-	c->set_contents = (int *)malloc(sizeof(int) * c->n_sets);
-	memset(c->set_contents, 0, sizeof(int) * c->n_sets);
+	// large caches only allocate the chunks of sets the trace touches.
+	c->sets = 0;
+	c->set_dir = 0;
+	c->chunks_touched = 0;
+	if (c->n_sets <= SPARSE_SET_THRESHOLD)
+	{
+		c->sets = (Pcache_set)malloc(sizeof(cache_set) * c->n_sets);
+		memset(c->sets, 0, sizeof(cache_set) * c->n_sets);
+	}
+	else
+	{
+		c->n_chunks = (c->n_sets + SET_CHUNK_SIZE - 1) >> SET_CHUNK_BITS;
+		c->set_dir = (Pcache_set *)malloc(sizeof(Pcache_set) * c->n_chunks);
+		memset(c->set_dir, 0, sizeof(Pcache_set) * c->n_chunks);
+	}
 
 	c->contents = 0;
+
+	// the counters of sets a sparse cache never touches stay unmapped zero pages
+	c->set_stats = 0;
+	if (cache_region_size)
+		c->set_stats = (Pset_stat)calloc(c->n_sets, sizeof(set_stat));
+
+	// large fully-associative caches index their lines by tag, from an
+	// arena with one spare line since misses insert before they evict.
+	c->fa_table = 0;
+	c->free_lines = 0;
+	if (c->n_sets == 1 && c->associativity >= FA_INDEX_MIN_ASSOC)
+	{
+		c->fa_bits = LOG2(c->associativity) + 2;
+		c->fa_table = (Pcache_line *)malloc(sizeof(Pcache_line) << c->fa_bits);
+		memset(c->fa_table, 0, sizeof(Pcache_line) << c->fa_bits);
+		c->line_arena = (Pcache_line)malloc(sizeof(cache_line) * (c->associativity + 1));
+		for (int i = 0; i <= c->associativity; i++)
+		{
+			c->line_arena[i].LRU_next = c->free_lines;
+			c->free_lines = &c->line_arena[i];
+		}
+	}
+
+	c->all_ways = c->associativity >= 64 ? ~0ull : (1ull << c->associativity) - 1;
+	if (cache_partitioned)
+	{
+		if (c->associativity > 64)
+		{
+			printf("error:  way partitioning supports at most 64 ways\n");
+			exit(-1);
+		}
+		for (int i = 0; i < MAX_CACHE_CLASSES; i++)
+		{
+			if (class_configured[i] && !(class_ways[i] & c->all_ways))
+			{
+				printf("error:  class %d has no ways in a %d-way cache\n", i, c->associativity);
+				exit(-1);
+			}
+		}
+	}
+
+	c->mshrs = 0;
+	c->n_mshrs_busy = 0;
+	if (cache_mshrs)
+		c->mshrs = (Pmshr)malloc(sizeof(mshr) * cache_mshrs);
 }
 /************************************************************/
 
@@ -68,6 +259,67 @@ void init_cache_instance(cache *c, int cache_size)
 /* initialize the cache and cache statistics data structures */
 void init_cache()
 {	
+	int sector_size = cache_sector_size ? cache_sector_size : cache_block_size;
+
+	if (sector_size > cache_block_size || cache_block_size / sector_size > MAX_CACHE_SECTORS)
+	{
+		printf("error:  sector size must divide the block size into 1..%d sectors\n", MAX_CACHE_SECTORS);
+		exit(-1);
+	}
+	if (sector_size != cache_block_size && cache_index_hash == INDEX_HASH_SKEW)
+	{
+		printf("error:  sectored skewed-associative caches are not supported\n");
+		exit(-1);
+	}
+	if (cache_opt && (cache_index_hash == INDEX_HASH_SKEW || cache_partitioned))
+	{
+		printf("error:  OPT replacement does not support skewed or partitioned caches\n");
+		exit(-1);
+	}
+	if (cache_region_size && cache_index_hash == INDEX_HASH_SKEW)
+	{
+		printf("error:  hotspots need a set-indexed cache, not a skewed one\n");
+		exit(-1);
+	}
+	cache_sectors = cache_block_size / sector_size;
+	cache_sector_words = sector_size / WORD_SIZE;
+	for (cache_sector_offset = 0; (1 << cache_sector_offset) < sector_size; cache_sector_offset++)
+		;
+
+	// a write buffer entry combines the words of one block, at most 64
+	if (cache_wbuf_entries)
+	{
+		wbuf = (Pwbuf_entry)malloc(sizeof(wbuf_entry) * cache_wbuf_entries);
+		wbuf_head = 0;
+		wbuf_count = 0;
+		for (wbuf_offset = WORD_SIZE_OFFSET; (1 << wbuf_offset) < cache_block_size &&
+			 wbuf_offset < WORD_SIZE_OFFSET + 6; wbuf_offset++)
+			;
+	}
+	memset(&wbuf_stats, 0, sizeof(wbuf_stats));
+
+	for (int i = 0; i < MAX_CACHE_CLASSES; i++)
+		if (!class_configured[i])
+			class_ways[i] = ~0ull;
+	memset(class_stats, 0, sizeof(class_stats));
+	cache_class = 0;
+
+	owner_stats = (Powner_stat)malloc(sizeof(owner_stat) * cache_owners);
+	memset(owner_stats, 0, sizeof(owner_stat) * cache_owners);
+	cache_owner = 0;
+	memset(repeat_line, 0, sizeof(repeat_line));
+	memset(repeat_stat, 0, sizeof(repeat_stat));
+	hot_set = NULL;
+	n_occ_samples = 0;
+
+	// one chunk of region counters is allocated for each range that misses
+	if (cache_region_size)
+	{
+		n_region_chunks = (int)((0xffffffffull / cache_region_size + SET_CHUNK_SIZE) >> SET_CHUNK_BITS);
+		region_dir = (unsigned long long **)calloc(n_region_chunks, sizeof(unsigned long long *));
+	}
+	occ_refs = 0;
+
 	/* initialize the cache */
 	if (cache_split)
 	{
@@ -82,469 +334,1314 @@ void init_cache()
 	/* initialize the cache statistics */
 	memset(&cache_stat_data, 0, sizeof(cache_stat));
 	memset(&cache_stat_inst, 0, sizeof(cache_stat));
+
+	cache_cycle = 0;
+	mshr_busy_until = 0;
+	mshr_busy_cycles = 0;
+	mshr_fill_cycles = 0;
 }
 /************************************************************/
 
 /************************************************************/
-/* update lru cache line in the set. */
-void apply_lru(Pcache c, unsigned int set_index, Pcache_line line)
+/* home slot of a tag in the fully-associative index */
+unsigned fa_slot(Pcache c, unsigned tag)
 {
-	delete(&c->LRU_head[set_index], &c->LRU_tail[set_index], line);
-	insert(&c->LRU_head[set_index], &c->LRU_tail[set_index], line);
+	return (tag * 2654435761u) >> (32 - c->fa_bits);
 }
 /************************************************************/
 
 /************************************************************/
-void process_access_load_instruction(Pcache c, unsigned addr, unsigned int set_index, unsigned int block_word_size, unsigned int tag)
+Pcache_line fa_lookup(Pcache c, unsigned tag)
 {
-	cache_stat_inst.accesses++;
+	unsigned mask = (1u << c->fa_bits) - 1;
+	unsigned i = fa_slot(c, tag);
 
-	// if set is empty
-	if (c->LRU_head[set_index] == 0)
-	{ // if the set is empty
-		Pcache_line line = malloc(sizeof(cache_line));
-		line->tag = tag;
-		line->dirty = 0;
+	while (c->fa_table[i])
+	{
+		if (c->fa_table[i]->tag == tag && c->fa_table[i]->owner == cache_owner)
+			return c->fa_table[i];
+		i = (i + 1) & mask;
+	}
+	return 0;
+}
+/************************************************************/
 
-		c->set_contents[set_index] = 1;
-		insert(&c->LRU_head[set_index], &c->LRU_tail[set_index], line);
+/************************************************************/
+void fa_insert(Pcache c, Pcache_line line)
+{
+	unsigned mask = (1u << c->fa_bits) - 1;
+	unsigned i = fa_slot(c, line->tag);
 
-		cache_stat_inst.misses++;
-		cache_stat_inst.demand_fetches += block_word_size;
-	}
-	else
+	while (c->fa_table[i])
+		i = (i + 1) & mask;
+	c->fa_table[i] = line;
+}
+/************************************************************/
+
+/************************************************************/
+/* remove a line, shifting back the entries of its probe run */
+void fa_remove(Pcache c, Pcache_line line)
+{
+	unsigned mask = (1u << c->fa_bits) - 1;
+	unsigned i = fa_slot(c, line->tag);
+	unsigned j, home;
+
+	while (c->fa_table[i] != line)
+		i = (i + 1) & mask;
+
+	for (j = (i + 1) & mask; c->fa_table[j]; j = (j + 1) & mask)
 	{
-		// if set is full.
-		if (c->set_contents[set_index] == c->associativity)
-		{
-			// find hit line
-			int found = 0;
-			Pcache_line cl = c->LRU_head[set_index];
-			for (int i = 0; i < c->set_contents[set_index]; i++)
-			{
-				if (cl->tag == tag)
-				{
-					found = 1;
-					break;
-				}
-				cl = cl->LRU_next;
-			}
+		// an entry whose home slot lies cyclically in (i, j] stays put.
+		home = fa_slot(c, c->fa_table[j]->tag);
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		c->fa_table[i] = c->fa_table[j];
+		i = j;
+	}
+	c->fa_table[i] = 0;
+}
+/************************************************************/
 
-			// if hit
-			if (found)
-			{
-				// process LRU
-				apply_lru(c, set_index, cl);
-			}
-			else
-			{// if missed
-				Pcache_line line = malloc(sizeof(cache_line));
-				line->tag = tag;
-				line->dirty = 0;
+/************************************************************/
+/* find the state of a set, allocating its chunk on first touch */
+Pcache_set get_set(Pcache c, unsigned int set_index)
+{
+	Pcache_set chunk;
 
-				// replace the exist LRU item with new line.
-				insert(&c->LRU_head[set_index], &c->LRU_tail[set_index], line);
+	if (c->sets)
+		return &c->sets[set_index];
 
-				if (c->LRU_tail[set_index]->dirty)
-				{
-					cache_stat_data.copies_back += block_word_size;
-				}
-				delete (&c->LRU_head[set_index], &c->LRU_tail[set_index], c->LRU_tail[set_index]);
+	chunk = c->set_dir[set_index >> SET_CHUNK_BITS];
+	if (!chunk)
+	{
+		chunk = (Pcache_set)malloc(sizeof(cache_set) * SET_CHUNK_SIZE);
+		memset(chunk, 0, sizeof(cache_set) * SET_CHUNK_SIZE);
+		c->set_dir[set_index >> SET_CHUNK_BITS] = chunk;
+		c->chunks_touched++;
+	}
+	return &chunk[set_index & (SET_CHUNK_SIZE - 1)];
+}
+/************************************************************/
 
-				cache_stat_inst.misses++;
-				cache_stat_inst.replacements++;
-				cache_stat_inst.demand_fetches += block_word_size;
-			}
-		}
-		else
-		{
-			// find hit line.
-			int found = 0;
-			Pcache_line cl = c->LRU_head[set_index];
-			for (int i = 0; i < c->set_contents[set_index]; i++)
-			{
-				if (cl->tag == tag)
-				{
-					found = 1;
-					break;
-				}
-				cl = cl->LRU_next;
-			}
+/************************************************************/
+/* restore the max-heap on next use around position i of a set's heap */
+void opt_sift(Pcache_set set, int i)
+{
+	Pcache_line *heap = set->heap;
+	Pcache_line line = heap[i];
+	int n = set->contents;
+	int child;
 
-			// if hit
-			if (found)
-			{
-				apply_lru(c, set_index, cl);
-			}
-			else
-			{
-				Pcache_line line = malloc(sizeof(cache_line));
-				line->tag = tag;
-				line->dirty = 0;
+	// move up past parents that are used sooner
+	while (i > 0 && heap[(i - 1) / 2]->next_use < line->next_use)
+	{
+		heap[i] = heap[(i - 1) / 2];
+		heap[i]->heap_pos = i;
+		i = (i - 1) / 2;
+	}
 
-				insert(&(c->LRU_head[set_index]), &(c->LRU_tail[set_index]), line);
-				c->set_contents[set_index]++;
-				c->contents++;
+	// or down past children that are used later
+	while ((child = 2 * i + 1) < n)
+	{
+		if (child + 1 < n && heap[child + 1]->next_use > heap[child]->next_use)
+			child++;
+		if (heap[child]->next_use <= line->next_use)
+			break;
+		heap[i] = heap[child];
+		heap[i]->heap_pos = i;
+		i = child;
+	}
 
-				cache_stat_inst.demand_fetches += block_word_size;
-				cache_stat_inst.misses++;
-			}
-		}
+	heap[i] = line;
+	line->heap_pos = i;
+}
+/************************************************************/
+
+/************************************************************/
+/* remove a line from its set's heap, the set still counts it */
+void opt_remove(Pcache_set set, Pcache_line line)
+{
+	Pcache_line last = set->heap[set->contents - 1];
+	int i = line->heap_pos;
+
+	set->contents--;
+	if (last != line)
+	{
+		set->heap[i] = last;
+		last->heap_pos = i;
+		opt_sift(set, i);
 	}
+	set->contents++;
 }
+/************************************************************/
 
 /************************************************************/
-void perform_access_load_data(Pcache c, unsigned addr, unsigned int set_index, unsigned int block_word_size, unsigned int tag)
+/* add the newest line of a set to its heap */
+void opt_insert(Pcache c, Pcache_set set, Pcache_line line)
 {
-	cache_stat_data.accesses++;
+	if (!set->heap)
+		set->heap = (Pcache_line *)malloc(sizeof(Pcache_line) * c->associativity);
+	set->heap[set->contents - 1] = line;
+	line->heap_pos = set->contents - 1;
+	opt_sift(set, set->contents - 1);
+}
+/************************************************************/
+
+/************************************************************/
+/* update lru cache line in the set. */
+void apply_lru(Pcache_set set, Pcache_line line)
+{
+	delete(&set->LRU_head, &set->LRU_tail, line);
+	insert(&set->LRU_head, &set->LRU_tail, line);
 
-	// if set is emtpy
-	if (c->LRU_head[set_index] == 0)
+	if (cache_opt)
 	{
-		Pcache_line line = malloc(sizeof(cache_line));
-		line->tag = tag;
-		line->dirty = 0;
+		line->next_use = cache_next_use;
+		opt_sift(set, line->heap_pos);
+	}
+}
+/************************************************************/
 
-		c->set_contents[set_index] = 1;
-		insert(&c->LRU_head[set_index], &c->LRU_tail[set_index], line);
+/************************************************************/
+/* remember the line a reference ended on for perform_repeat */
+void set_repeat(unsigned access_type, Pcache_set set, Pcache_line line)
+{
+	repeat_line[access_type] = line;
+	repeat_set[access_type] = set;
+	repeat_stat[access_type] = hot_set;
+}
+/************************************************************/
 
-		cache_stat_data.misses++;
-		cache_stat_data.demand_fetches += block_word_size;
+/************************************************************/
+/* drop a line of a full set */
+void evict(Pcache c, Pcache_set set, Pcache_line victim)
+{
+	int i;
+
+	for (i = 0; i <= TRACE_INST_LOAD; i++)
+		if (repeat_line[i] == victim)
+			repeat_line[i] = NULL;
+	set->ways_used &= ~(1ull << victim->way);
+	if (cache_opt)
+		opt_remove(set, victim);
+	if (cache_owners > 1)
+		owner_evict(victim->owner);
+	PROF_ENTER(PROF_LRU);
+	delete(&set->LRU_head, &set->LRU_tail, victim);
+	PROF_LEAVE();
+	if (c->fa_table)
+	{
+		fa_remove(c, victim);
+		victim->LRU_next = c->free_lines;
+		c->free_lines = victim;
 	}
 	else
-	{
-		// if the set is full
-		if (c->set_contents[set_index] == c->associativity)
-		{
-			// find hit line.
-			int found = 0;
-			Pcache_line cl = c->LRU_head[set_index];
-			for (int i = 0; i < c->set_contents[set_index]; i++)
-			{
-				if (cl->tag == tag)
-				{
-					found = 1;
-					break;
-				}
-				cl = cl->LRU_next;
-			}
+		free(victim);
+}
+/************************************************************/
 
-			if (found)
-			{
-				apply_lru(c, set_index, cl);
-			}
-			else
-			{
-				Pcache_line line = malloc(sizeof(cache_line));
-				line->tag = tag;
-				line->dirty = 0;
+/************************************************************/
+/* look up a tag in a set */
+Pcache_line find_line(Pcache c, Pcache_set set, unsigned tag)
+{
+	Pcache_line cl;
 
-				if (c->LRU_tail[set_index]->dirty)
-				{
-					cache_stat_data.copies_back += block_word_size;
-				}
+	if (c->fa_table)
+		return fa_lookup(c, tag);
 
-				// replace the exist LRU item with new line.
-				delete (&c->LRU_head[set_index], &c->LRU_tail[set_index], c->LRU_tail[set_index]);
-				insert(&(c->LRU_head[set_index]), &(c->LRU_tail[set_index]), line);
+	for (cl = set->LRU_head; cl; cl = cl->LRU_next)
+	{
+		if (cl->tag == tag && cl->owner == cache_owner)
+			return cl;
+	}
+	return 0;
+}
+/************************************************************/
 
-				cache_stat_data.demand_fetches += block_word_size;
-				cache_stat_data.misses++;
-				cache_stat_data.replacements++;
-			}
-		}
+/************************************************************/
+/* release the MSHRs whose fill has completed by the current cycle */
+void mshr_retire(Pcache c)
+{
+	int i = 0;
+
+	while (i < c->n_mshrs_busy)
+	{
+		if (c->mshrs[i].ready <= cache_cycle)
+			c->mshrs[i] = c->mshrs[--c->n_mshrs_busy];
 		else
-		{
-			// find hit line
-			int found = 0;
-			Pcache_line cl = c->LRU_head[set_index];
-			for (int i = 0; i < c->set_contents[set_index]; i++)
-			{
-				if (cl->tag == tag)
-				{
-					found = 1;
-					break;
-				}
-				cl = cl->LRU_next;
-			}
+			i++;
+	}
+}
+/************************************************************/
 
-			if (found)
-			{
-				apply_lru(c, set_index, cl);
-			}
-			else
-			{
-				Pcache_line line = malloc(sizeof(cache_line));
-				line->tag = tag;
-				line->dirty = 0;
+/************************************************************/
+/* allocate an MSHR for a missing block, returns the cycle its fill completes */
+unsigned long long mshr_allocate(Pcache c, Pcache_stat stat, unsigned block)
+{
+	int i, oldest;
+	unsigned long long ready;
 
-				insert(&(c->LRU_head[set_index]), &(c->LRU_tail[set_index]), line);
-				c->set_contents[set_index]++;
-				c->contents++;
+	mshr_retire(c);
 
-				cache_stat_data.demand_fetches += block_word_size;
-				cache_stat_data.misses++;
-			}
+	// the block is already being fetched, merge with the outstanding miss.
+	for (i = 0; i < c->n_mshrs_busy; i++)
+	{
+		if (c->mshrs[i].block == block)
+		{
+			stat->secondary_misses++;
+			return c->mshrs[i].ready;
 		}
 	}
+
+	// all MSHRs are busy, stall until the earliest fill completes.
+	if (c->n_mshrs_busy == cache_mshrs)
+	{
+		oldest = 0;
+		for (i = 1; i < c->n_mshrs_busy; i++)
+			if (c->mshrs[i].ready < c->mshrs[oldest].ready)
+				oldest = i;
+
+		stat->mshr_stalls++;
+		stat->stall_cycles += c->mshrs[oldest].ready - cache_cycle;
+		cache_cycle = c->mshrs[oldest].ready;
+		mshr_retire(c);
+	}
+
+	ready = cache_cycle + cache_fill_latency;
+	c->mshrs[c->n_mshrs_busy].block = block;
+	c->mshrs[c->n_mshrs_busy].ready = ready;
+	c->n_mshrs_busy++;
+
+	// fills are issued in cycle order, so the busy time is the union of
+	// [issue, ready) intervals and only grows past mshr_busy_until.
+	mshr_fill_cycles += cache_fill_latency;
+	if (cache_cycle >= mshr_busy_until)
+		mshr_busy_cycles += cache_fill_latency;
+	else
+		mshr_busy_cycles += ready - mshr_busy_until;
+	mshr_busy_until = ready;
+
+	return ready;
 }
+/************************************************************/
 
 /************************************************************/
-void perform_access_store_data(Pcache c, unsigned addr, unsigned int set_index, unsigned int block_word_size, unsigned int tag)
+/* a hit on a line whose fill is still in flight is a secondary miss */
+void mshr_hit(Pcache_line line, Pcache_stat stat)
 {
-	cache_stat_data.accesses++;
+	if (line->timestamp > cache_cycle)
+		stat->secondary_misses++;
+}
+/************************************************************/
+
+/************************************************************/
+/* write the head entry of the write buffer to memory */
+void wbuf_pop()
+{
+	unsigned long long words = wbuf[wbuf_head].words;
+	unsigned addr = wbuf[wbuf_head].block << wbuf_offset;
 
-	// if set is empty
-	if (c->LRU_head[set_index] == 0)
+	for (; words; words >>= 1, addr += WORD_SIZE)
 	{
-		if (cache_writealloc == 0)
-		{
-			cache_stat_data.copies_back += 1;
-			cache_stat_data.misses++;
-		}
+		if (!(words & 1))
+			continue;
+		cache_stat_data.copies_back++;
+		if (cache_emit)
+			emit_reference(TRACE_DATA_STORE, addr);
+	}
+	wbuf_stats.writes++;
 
-		else
-		{
-			Pcache_line line = malloc(sizeof(cache_line));
+	wbuf_head = (wbuf_head + 1) % cache_wbuf_entries;
+	wbuf_count--;
+	wbuf_drain_at += cache_wbuf_drain;
+}
+/************************************************************/
 
-			line->tag = tag;
-			line->dirty = 1;
+/************************************************************/
+/* drain the entries that have reached memory by the current cycle */
+void wbuf_retire()
+{
+	while (wbuf_count && wbuf_drain_at <= cache_cycle)
+		wbuf_pop();
+}
+/************************************************************/
 
-			// modify to the cache memory
-			if (cache_writeback == 0)
-			{
-				cache_stat_data.copies_back += 1;
-				line->dirty = 0;
-			}
-			c->set_contents[set_index] = 1;
-			insert(&c->LRU_head[set_index], &c->LRU_tail[set_index], line);
+/************************************************************/
+/* a store that writes through the cache */
+void write_through(unsigned addr)
+{
+	unsigned block, word;
+	int i, slot;
+
+	if (!cache_wbuf_entries)
+	{
+		cache_stat_data.copies_back += 1;
+		if (cache_emit)
+			emit_reference(TRACE_DATA_STORE, addr);
+		return;
+	}
+
+	block = addr >> wbuf_offset;
+	word = (addr >> WORD_SIZE_OFFSET) & ((1u << (wbuf_offset - WORD_SIZE_OFFSET)) - 1);
+	wbuf_retire();
 
-			cache_stat_data.misses++;
-			cache_stat_data.demand_fetches += block_word_size;
+	// combine with a pending store to the same block
+	for (i = 0; i < wbuf_count; i++)
+	{
+		slot = (wbuf_head + i) % cache_wbuf_entries;
+		if (wbuf[slot].block == block)
+		{
+			wbuf[slot].words |= 1ull << word;
+			wbuf_stats.coalesced++;
+			return;
 		}
 	}
-	else
+
+	// the buffer is full, stall until its head drains
+	if (wbuf_count == cache_wbuf_entries)
+	{
+		wbuf_stats.full_stalls++;
+		wbuf_stats.stall_cycles += wbuf_drain_at - cache_cycle;
+		cache_cycle = wbuf_drain_at;
+		wbuf_retire();
+	}
+
+	if (wbuf_count == 0)
+		wbuf_drain_at = cache_cycle + cache_wbuf_drain;
+	slot = (wbuf_head + wbuf_count) % cache_wbuf_entries;
+	wbuf[slot].block = block;
+	wbuf[slot].words = 1ull << word;
+	wbuf_count++;
+}
+/************************************************************/
+
+/************************************************************/
+/* a fill from memory must observe the stores still in the write buffer */
+void wbuf_fill(unsigned addr)
+{
+	unsigned block = addr >> wbuf_offset;
+	int i;
+
+	wbuf_retire();
+	for (i = 0; i < wbuf_count; i++)
 	{
-		// if set is full
-		if (c->set_contents[set_index] == c->associativity)
+		if (wbuf[(wbuf_head + i) % cache_wbuf_entries].block != block)
+			continue;
+
+		if (cache_wbuf_bypass)
 		{
-			// find hit line
-			int found = 0;
-			Pcache_line cl = c->LRU_head[set_index];
-			for (int i = 0; i < c->set_contents[set_index]; i++)
-			{
-				if (cl->tag == tag)
-				{
-					found = 1;
-					break;
-				}
-				cl = cl->LRU_next;
-			}
-			if (found)
-			{
-				// apply LRU
-				apply_lru(c, set_index, cl);
+			// forward the buffered data, the fill does not wait
+			wbuf_stats.raw_bypasses++;
+			return;
+		}
 
-				c->LRU_head[set_index]->dirty = 1;
-				if (cache_writeback == 0)
-				{
-					cache_stat_data.copies_back += 1;
-					c->LRU_head[set_index]->dirty = 0;
-				}
-			}
-			else
+		// wait until the matching entry has drained
+		wbuf_stats.raw_stalls++;
+		wbuf_stats.stall_cycles += wbuf_drain_at + i * cache_wbuf_drain - cache_cycle;
+		cache_cycle = wbuf_drain_at + i * cache_wbuf_drain;
+		wbuf_retire();
+		return;
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* a line only holds the sectors that have been fetched into it */
+unsigned long long sector_bit(unsigned addr)
+{
+	return 1ull << ((addr >> cache_sector_offset) & (cache_sectors - 1));
+}
+/************************************************************/
+
+/************************************************************/
+/* fetch a missing sector of a present line, returns FALSE when a store
+   to it goes around a no-write-allocate cache instead */
+int sector_fill(Pcache_line line, unsigned addr, Pcache_stat stat, int is_store)
+{
+	unsigned long long bit = sector_bit(addr);
+
+	if (line->valid_sectors & bit)
+		return TRUE;
+
+	stat->misses++;
+	stat->sector_misses++;
+	if (is_store && cache_writealloc == 0)
+	{
+		write_through(addr);
+		return FALSE;
+	}
+
+	line->valid_sectors |= bit;
+	stat->demand_fetches += cache_sector_words;
+	if (cache_emit)
+		emit_fill(stat, addr);
+	return TRUE;
+}
+/************************************************************/
+
+/************************************************************/
+/* a block or sector fetched from memory, as seen below the cache */
+void emit_fill(Pcache_stat stat, unsigned addr)
+{
+	emit_reference(stat == &cache_stat_inst ? TRACE_INST_LOAD : TRACE_DATA_LOAD,
+		addr >> cache_sector_offset << cache_sector_offset);
+}
+/************************************************************/
+
+/************************************************************/
+/* the stores that write a dirty line back to memory */
+void emit_writeback(Pcache_line line)
+{
+	unsigned base = line->address & ~(cache_block_size - 1);
+	int i;
+
+	for (i = 0; i < cache_sectors; i++)
+		if (cache_sectors == 1 || (line->dirty_sectors >> i & 1))
+			emit_reference(TRACE_DATA_STORE, base + (i << cache_sector_offset));
+}
+/************************************************************/
+
+/************************************************************/
+/* words written back when a dirty line leaves the cache */
+int writeback_words(Pcache_line line)
+{
+	unsigned long long dirty = line->dirty_sectors;
+	int n = 0;
+
+	if (cache_sectors == 1)
+		return words_per_block;
+
+	for (; dirty; dirty &= dirty - 1)
+		n++;
+	return n * cache_sector_words;
+}
+/************************************************************/
+
+/************************************************************/
+/* allocate a line for a missing block and start its fill */
+Pcache_line new_line(Pcache c, Pcache_stat stat, unsigned addr, unsigned tag, int dirty)
+{
+	Pcache_line line;
+
+	if (c->fa_table)
+	{
+		line = c->free_lines;
+		c->free_lines = line->LRU_next;
+	}
+	else
+		line = malloc(sizeof(cache_line));
+	line->tag = tag;
+	line->dirty = dirty;
+	line->owner = cache_owner;
+	line->way = 0;
+	line->next_use = cache_next_use;
+	owner_stats[cache_owner].lines++;
+	line->valid_sectors = sector_bit(addr);
+	line->dirty_sectors = dirty ? line->valid_sectors : 0;
+	line->address = addr;
+	line->timestamp = 0;
+
+	if (cache_emit)
+		emit_fill(stat, addr);
+	if (cache_wbuf_entries)
+		wbuf_fill(addr);
+	if (cache_mshrs)
+		line->timestamp = mshr_allocate(c, stat, addr >> c->index_mask_offset);
+	if (c->fa_table)
+		fa_insert(c, line);
+
+	return line;
+}
+/************************************************************/
+
+/************************************************************/
+/* reduce a hash to a set number */
+unsigned int set_reduce(Pcache c, unsigned int h)
+{
+	if (c->pow2_sets)
+		return h & (c->n_sets - 1);
+	return fastdiv_mod(&c->set_div, h);
+}
+/************************************************************/
+
+/************************************************************/
+/* set index of a block under the cache's index function */
+unsigned int cache_index(Pcache c, unsigned int block)
+{
+	unsigned int index, upper;
+
+	switch (c->index_hash)
+	{
+	case INDEX_HASH_XOR:
+		// fold every set_bits wide slice of the block address together
+		index = block;
+		if (c->set_bits)
+			for (upper = block >> c->set_bits; upper; upper >>= c->set_bits)
+				index ^= upper;
+		return set_reduce(c, index);
+
+	case INDEX_HASH_PRIME:
+	case INDEX_HASH_MODULO:
+		return fastdiv_mod(&c->set_div, block);
+
+	default:
+		return block & (c->n_sets - 1);
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* set index of a block in one way of a skewed-associative cache */
+unsigned int skew_index(Pcache c, int way, unsigned int block)
+{
+	unsigned int h;
+
+	// way 0 uses the plain index, the others a per-way multiplicative mix
+	if (way == 0)
+		return set_reduce(c, block);
+	h = (block ^ (block >> c->set_bits)) * (2654435761u + 2 * way);
+	return set_reduce(c, h ^ (h >> 16));
+}
+/************************************************************/
+
+/************************************************************/
+/* access a skewed-associative cache, each way has its own index */
+void perform_access_skewed(Pcache c, unsigned addr, unsigned access_type, unsigned int block_word_size)
+{
+	Pcache_stat stat = (access_type == TRACE_INST_LOAD) ? &cache_stat_inst : &cache_stat_data;
+	unsigned int block = addr >> c->index_mask_offset;
+	Pskew_line line, victim = 0;
+	int way;
+
+	stat->accesses++;
+	c->skew_clock++;
+
+	for (way = 0; way < c->associativity; way++)
+	{
+		line = &c->skew_lines[way * c->n_sets + skew_index(c, way, block)];
+		if (line->valid && line->tag == block && line->owner == cache_owner)
+		{
+			line->lru = c->skew_clock;
+			if (access_type == TRACE_DATA_STORE)
 			{
-				if (cache_writealloc == 0)
-				{
-					cache_stat_data.copies_back += 1;
-					cache_stat_data.misses++;
-				}
-				else
+				line->dirty = 1;
+				if (cache_writeback == 0)
 				{
-					Pcache_line line = malloc(sizeof(cache_line));
-					line->tag = tag;
-					line->dirty = 1;
-
-					if (c->LRU_tail[set_index]->dirty)
-					{
-						cache_stat_data.copies_back += block_word_size;
-					}
-					if (cache_writeback == 0)
-					{
-						cache_stat_data.copies_back += 1;
-						line->dirty = 0;
-					}
-					delete(&c->LRU_head[set_index], &c->LRU_tail[set_index], c->LRU_tail[set_index]);
-					insert(&(c->LRU_head[set_index]), &(c->LRU_tail[set_index]), line);
-
-					cache_stat_data.demand_fetches += block_word_size;
-					cache_stat_data.misses++;
-					cache_stat_data.replacements++;
+					write_through(addr);
+					line->dirty = 0;
 				}
 			}
+			return;
 		}
-		else
+
+		// prefer an invalid candidate, then the least recently used one,
+		// among the ways the requesting class may fill
+		if (cache_partitioned && !(class_ways[cache_class] >> way & 1))
+			continue;
+		if (!victim || (victim->valid && (!line->valid || line->lru < victim->lru)))
+			victim = line;
+	}
+
+	stat->misses++;
+	if (access_type == TRACE_DATA_STORE && cache_writealloc == 0)
+	{
+		write_through(addr);
+		return;
+	}
+
+	if (victim->valid)
+	{
+		if (cache_owners > 1)
+			owner_evict(victim->owner);
+		stat->replacements++;
+		if (victim->dirty)
+		{
+			cache_stat_data.copies_back += block_word_size;
+			if (cache_emit)
+				emit_reference(TRACE_DATA_STORE, victim->tag << c->index_mask_offset);
+		}
+	}
+	else
+		c->contents++;
+
+	if (cache_wbuf_entries)
+		wbuf_fill(addr);
+	victim->tag = block;
+	victim->owner = cache_owner;
+	owner_stats[cache_owner].lines++;
+	victim->valid = 1;
+	victim->dirty = 0;
+	victim->lru = c->skew_clock;
+	stat->demand_fetches += block_word_size;
+	if (cache_emit)
+		emit_fill(stat, addr);
+
+	if (access_type == TRACE_DATA_STORE)
+	{
+		victim->dirty = 1;
+		if (cache_writeback == 0)
+		{
+			write_through(addr);
+			victim->dirty = 0;
+		}
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* no way the requesting class may fill is free */
+int set_full(Pcache c, Pcache_set set)
+{
+	if (!cache_partitioned)
+		return set->contents == c->associativity;
+	return !(~set->ways_used & class_ways[cache_class] & c->all_ways);
+}
+/************************************************************/
+
+/************************************************************/
+/* the LRU line among the ways the requesting class may replace */
+Pcache_line choose_victim(Pcache_set set)
+{
+	Pcache_line cl = set->LRU_tail;
+
+	// OPT evicts the line whose next use is furthest away
+	if (cache_opt)
+		return set->heap[0];
+
+	if (cache_partitioned)
+		while (!(class_ways[cache_class] >> cl->way & 1))
+			cl = cl->LRU_prev;
+	return cl;
+}
+/************************************************************/
+
+/************************************************************/
+/* make room for a missing block and insert its line at the MRU end */
+void fill_line(Pcache c, Pcache_set set, Pcache_line line, Pcache_stat stat)
+{
+	unsigned long long free_ways;
+	Pcache_line victim;
+
+	if (set_full(c, set))
+	{
+		// replace the LRU item with the new line.
+		victim = choose_victim(set);
+		if (victim->dirty)
+		{
+			cache_stat_data.copies_back += writeback_words(victim);
+			if (cache_emit)
+				emit_writeback(victim);
+		}
+		line->way = victim->way;
+		if (hot_set)
+		{
+			hot_set->evictions++;
+			hot_set->dirty_evictions += victim->dirty;
+		}
+		evict(c, set, victim);
+
+		stat->replacements++;
+	}
+	else
+	{
+		if (cache_partitioned)
+		{
+			free_ways = ~set->ways_used & class_ways[cache_class] & c->all_ways;
+			for (line->way = 0; !(free_ways >> line->way & 1); line->way++)
+				;
+		}
+		set->contents++;
+		c->contents++;
+	}
+
+	set->ways_used |= 1ull << line->way;
+	PROF_ENTER(PROF_LRU);
+	insert(&set->LRU_head, &set->LRU_tail, line);
+	PROF_LEAVE();
+	if (cache_opt)
+		opt_insert(c, set, line);
+}
+/************************************************************/
+
+/************************************************************/
+void process_access_load_instruction(Pcache c, unsigned addr, unsigned int set_index, unsigned int block_word_size, unsigned int tag)
+{
+	Pcache_set set;
+	Pcache_line cl, line;
+
+	cache_stat_inst.accesses++;
+
+	// find hit line
+	PROF_ENTER(PROF_LOOKUP);
+	set = get_set(c, set_index);
+	cl = find_line(c, set, tag);
+	PROF_LEAVE();
+
+	// if hit
+	if (cl)
+	{
+		if (cache_mshrs)
+			mshr_hit(cl, &cache_stat_inst);
+		if (cache_sectors > 1)
+			sector_fill(cl, addr, &cache_stat_inst, FALSE);
+		// process LRU
+		PROF_ENTER(PROF_LRU);
+		apply_lru(set, cl);
+		PROF_LEAVE();
+		set_repeat(TRACE_INST_LOAD, set, cl);
+		return;
+	}
+
+	// if missed
+	PROF_ENTER(PROF_MISS);
+	line = new_line(c, &cache_stat_inst, addr, tag, 0);
+	fill_line(c, set, line, &cache_stat_inst);
+	set_repeat(TRACE_INST_LOAD, set, line);
+	PROF_LEAVE();
+
+	cache_stat_inst.misses++;
+	cache_stat_inst.demand_fetches += block_word_size;
+}
+
+/************************************************************/
+void perform_access_load_data(Pcache c, unsigned addr, unsigned int set_index, unsigned int block_word_size, unsigned int tag)
+{
+	Pcache_set set;
+	Pcache_line cl, line;
+
+	cache_stat_data.accesses++;
+
+	// find hit line
+	PROF_ENTER(PROF_LOOKUP);
+	set = get_set(c, set_index);
+	cl = find_line(c, set, tag);
+	PROF_LEAVE();
+
+	if (cl)
+	{
+		if (cache_mshrs)
+			mshr_hit(cl, &cache_stat_data);
+		if (cache_sectors > 1)
+			sector_fill(cl, addr, &cache_stat_data, FALSE);
+		PROF_ENTER(PROF_LRU);
+		apply_lru(set, cl);
+		PROF_LEAVE();
+		set_repeat(TRACE_DATA_LOAD, set, cl);
+		return;
+	}
+
+	PROF_ENTER(PROF_MISS);
+	line = new_line(c, &cache_stat_data, addr, tag, 0);
+	fill_line(c, set, line, &cache_stat_data);
+	set_repeat(TRACE_DATA_LOAD, set, line);
+	PROF_LEAVE();
+
+	cache_stat_data.demand_fetches += block_word_size;
+	cache_stat_data.misses++;
+}
+
+/************************************************************/
+void perform_access_store_data(Pcache c, unsigned addr, unsigned int set_index, unsigned int block_word_size, unsigned int tag)
+{
+	Pcache_set set;
+	Pcache_line cl, line;
+
+	cache_stat_data.accesses++;
+
+	// find hit line
+	PROF_ENTER(PROF_LOOKUP);
+	set = get_set(c, set_index);
+	cl = find_line(c, set, tag);
+	PROF_LEAVE();
+
+	if (cl)
+	{
+		if (cache_mshrs)
+			mshr_hit(cl, &cache_stat_data);
+		// apply LRU
+		PROF_ENTER(PROF_LRU);
+		apply_lru(set, cl);
+		PROF_LEAVE();
+		set_repeat(TRACE_DATA_STORE, set, cl);
+
+		// a store to a missing sector of a no-write-allocate cache goes around it
+		if (cache_sectors == 1 || sector_fill(cl, addr, &cache_stat_data, TRUE))
 		{
-			// find hit line.
-			int found = 0;
-			Pcache_line cl = c->LRU_head[set_index];
-			for (int i = 0; i < c->set_contents[set_index]; i++)
+			cl->dirty = 1;
+			cl->dirty_sectors |= sector_bit(addr);
+			if (cache_writeback == 0)
 			{
-				if (cl->tag == tag)
-				{
-					found = 1;
-					break;
-				}
-				cl = cl->LRU_next;
+				write_through(addr);
+				cl->dirty = 0;
 			}
+		}
+		return;
+	}
 
-			if (found)
-			{
-				// apply LRU
-				apply_lru(c, set_index, cl);
+	cache_stat_data.misses++;
+	PROF_ENTER(PROF_MISS);
+	if (cache_writealloc == 0)
+	{
+		write_through(addr);
+		set_repeat(TRACE_DATA_STORE, set, NULL);
+		PROF_LEAVE();
+		return;
+	}
 
-				c->LRU_head[set_index]->dirty = 1;
-				if (cache_writeback == 0)
-				{
-					cache_stat_data.copies_back += 1;
-					c->LRU_head[set_index]->dirty = 0;
-				}
-			}
-			else
-			{
-				if (cache_writealloc == 0)
-				{
-					cache_stat_data.misses++;
-					cache_stat_data.copies_back += 1;
-				}
+	line = new_line(c, &cache_stat_data, addr, tag, 1);
+
+	// modify to the cache memory
+	if (cache_writeback == 0)
+	{
+		write_through(addr);
+		line->dirty = 0;
+	}
+	fill_line(c, set, line, &cache_stat_data);
+	set_repeat(TRACE_DATA_STORE, set, line);
+	PROF_LEAVE();
+
+	cache_stat_data.demand_fetches += block_word_size;
+}
+
+/************************************************************/
+/* count a miss in the histogram of its address region */
+void count_region_miss(unsigned addr)
+{
+	unsigned region = addr / cache_region_size;
+	unsigned long long *chunk = region_dir[region >> SET_CHUNK_BITS];
+
+	if (!chunk)
+	{
+		chunk = (unsigned long long *)calloc(SET_CHUNK_SIZE, sizeof(unsigned long long));
+		region_dir[region >> SET_CHUNK_BITS] = chunk;
+	}
+	chunk[region & (SET_CHUNK_SIZE - 1)]++;
+}
+/************************************************************/
+
+/************************************************************/
+void perform_access_unified(Pcache c, unsigned int addr, unsigned access_type)
+{
+	// a miss only fetches the referenced sector of a sectored cache
+	int block_word_size = cache_sector_words;
+	unsigned int set_index, tag;
+	long long misses = 0;
+
+	if (c->skew_lines)
+	{
+		perform_access_skewed(c, addr, access_type, block_word_size);
+		return;
+	}
+
+	// the tag is the whole block address, which stays correct for any
+	// index function.
+	PROF_ENTER(PROF_INDEX);
+	tag = addr >> c->index_mask_offset;
+	if (c->index_hash == INDEX_HASH_PLAIN)
+		set_index = (addr & c->index_mask) >> c->index_mask_offset;
+	else
+		set_index = cache_index(c, tag);
+	PROF_LEAVE();
+
+	if (c->set_stats)
+	{
+		hot_set = &c->set_stats[set_index];
+		hot_set->accesses++;
+		misses = cache_stat_inst.misses + cache_stat_data.misses;
+	}
+	
+	switch (access_type)
+	{
+	case TRACE_INST_LOAD:
+		process_access_load_instruction(c, addr, set_index, block_word_size, tag);
+		break;
+
+	case TRACE_DATA_LOAD:
+		perform_access_load_data(c, addr, set_index, block_word_size, tag);
+		break;
+
+	case TRACE_DATA_STORE:
+		perform_access_store_data(c, addr, set_index, block_word_size, tag);
+		break;
+	}
+
+	if (c->set_stats && cache_stat_inst.misses + cache_stat_data.misses != misses)
+	{
+		hot_set->misses++;
+		count_region_miss(addr);
+	}
+}
+
+/************************************************************/
+
+/************************************************************/
+void perform_access_split(Pcache c_data, Pcache c_inst, unsigned int addr, unsigned int access_type)
+{
+	// each side of a split cache is indexed on its own, like a unified one
+	if (access_type == TRACE_INST_LOAD)
+		perform_access_unified(c_inst, addr, access_type);
+	else
+		perform_access_unified(c_data, addr, access_type);
+}
+
+/************************************************************/
+void perform_access(addr, access_type) 
+unsigned addr, access_type;
+{
+	Powner_stat owner = &owner_stats[cache_owner];
+	long long misses = cache_stat_inst.misses + cache_stat_data.misses;
+
+	PROF_ENTER(PROF_ACCESS);
+	cache_cycle++;
+
+	// handle the access to the cache
+	if (cache_split)
+	{// if data cache and instruction cache are used seperately
+		perform_access_split(&c1, &c2, addr, access_type);
+	}
+	else
+	{// if data cache and instruction cache are used integrally,
+		perform_access_unified(&c1, addr, access_type);
+	}
+
+	misses = cache_stat_inst.misses + cache_stat_data.misses - misses;
+	owner->accesses++;
+	owner->misses += misses;
+	class_stats[cache_class].accesses++;
+	class_stats[cache_class].misses += misses;
+	if (cache_occ_interval && !(++occ_refs % cache_occ_interval))
+		sample_occupancy();
+	PROF_LEAVE();
+}
+/************************************************************/
+
+/************************************************************/
+/* a reference to the block the previous reference of the same type
+   touched. While that line is still the MRU line of its set and holds
+   the sector, the reference is a hit that only updates counters and
+   dirty bits, so the set lookup is skipped; otherwise it is simulated
+   in full. */
+void perform_repeat(addr, access_type)
+unsigned addr, access_type;
+{
+	Pcache_line line = repeat_line[access_type];
+	Pcache_stat stat;
+
+	if (!line || repeat_set[access_type]->LRU_head != line || cache_opt ||
+		line->tag != addr >> c1.index_mask_offset || line->owner != cache_owner ||
+		!(line->valid_sectors & sector_bit(addr)))
+	{
+		perform_access(addr, access_type);
+		return;
+	}
+
+	PROF_ENTER(PROF_ACCESS);
+	cache_cycle++;
+	stat = access_type == TRACE_INST_LOAD ? &cache_stat_inst : &cache_stat_data;
+	stat->accesses++;
+	if (repeat_stat[access_type])
+		repeat_stat[access_type]->accesses++;
+	if (cache_mshrs)
+		mshr_hit(line, stat);
+	if (access_type == TRACE_DATA_STORE)
+	{
+		line->dirty = 1;
+		line->dirty_sectors |= sector_bit(addr);
+		if (cache_writeback == 0)
+		{
+			write_through(addr);
+			line->dirty = 0;
+		}
+	}
+
+	owner_stats[cache_owner].accesses++;
+	class_stats[cache_class].accesses++;
+	if (cache_occ_interval && !(++occ_refs % cache_occ_interval))
+		sample_occupancy();
+	PROF_LEAVE();
+}
+/************************************************************/
+
+/************************************************************/
+/* the co-running trace that issues the following references */
+void set_cache_owner(owner)
+int owner;
+{
+	cache_owner = owner;
+}
+/************************************************************/
+
+/************************************************************/
+/* index of the next reference to the block of the following one */
+void set_cache_next_use(next_use)
+unsigned long long next_use;
+{
+	cache_next_use = next_use;
+}
+/************************************************************/
+
+/************************************************************/
+/* key of the block a reference touches, distinct per cache */
+unsigned cache_block_key(addr, access_type)
+unsigned addr, access_type;
+{
+	return (addr >> c1.index_mask_offset) << 1 | (cache_split && access_type == TRACE_INST_LOAD);
+}
+/************************************************************/
 
-				else
-				{
-					Pcache_line line = malloc(sizeof(cache_line));
-					line->tag = tag;
-					line->dirty = 1;
-
-					if (cache_writeback == 0)
-					{
-						cache_stat_data.copies_back += 1;
-						line->dirty = 0;
-					}
-					insert(&(c->LRU_head[set_index]), &(c->LRU_tail[set_index]), line);
-					
-					c->set_contents[set_index]++;
-					c->contents++;
-
-					cache_stat_data.demand_fetches += block_word_size;
-					cache_stat_data.misses++;
-				}
-			}
-		}
-	}
+/************************************************************/
+/* the class of service of the following references */
+void set_cache_class(cls)
+int cls;
+{
+	cache_class = cls;
 }
+/************************************************************/
 
 /************************************************************/
-void perform_access_unified(Pcache c, unsigned int addr, unsigned access_type)
+/* restrict the ways a class may fill to those set in mask */
+void set_class_ways(cls, mask)
+int cls;
+unsigned long long mask;
 {
-	int block_word_size = cache_block_size / WORD_SIZE;
-	int set_index = (addr & c->index_mask) >> c->index_mask_offset;
-	int tag = addr & 0xFFFFFFFF << (LOG2(cache_block_size) + LOG2(c->n_sets));
-	
-	switch (access_type)
+	if (cls < 0 || cls >= MAX_CACHE_CLASSES || !mask)
 	{
-	case TRACE_INST_LOAD:
-		process_access_load_instruction(c, addr, set_index, block_word_size, tag);
-		break;
-
-	case TRACE_DATA_LOAD:
-		perform_access_load_data(c, addr, set_index, block_word_size, tag);
-		break;
-
-	case TRACE_DATA_STORE:
-		perform_access_store_data(c, addr, set_index, block_word_size, tag);
-		break;
+		printf("error set_class_ways: need a class below %d and a non-empty way mask\n", MAX_CACHE_CLASSES);
+		exit(-1);
 	}
+	class_ways[cls] = mask;
+	class_configured[cls] = TRUE;
+	cache_partitioned = TRUE;
 }
-
 /************************************************************/
 
 /************************************************************/
-void perform_access_split(Pcache c_data, Pcache c_inst, unsigned int addr, unsigned int access_type)
+/* a line of owner leaves the cache to make room for cache_owner */
+void owner_evict(int owner)
 {
-	unsigned int data_set_index, inst_set_index;
-	unsigned int data_tag, inst_tag;
-
-	int block_word_size = cache_block_size / WORD_SIZE;
-	
-	data_tag = addr & (0xFFFFFFFF << (LOG2(cache_block_size) + LOG2(c_data->n_sets)));
-	inst_tag = addr & (0xFFFFFFFF << (LOG2(cache_block_size) + LOG2(c_inst->n_sets)));
-
-	data_set_index = (addr & c_data->index_mask) >> c_data->index_mask_offset;
-	inst_set_index = (addr & c_inst->index_mask) >> c_inst->index_mask_offset;
-
-	switch (access_type)
+	owner_stats[owner].lines--;
+	if (owner != cache_owner)
 	{
-	case TRACE_INST_LOAD:
-		process_access_load_instruction(c_inst, addr, inst_set_index, block_word_size, inst_tag);
-		break;
-	case TRACE_DATA_LOAD:
-		perform_access_load_data(c_data, addr, data_set_index, block_word_size, data_tag);
-		break;
-	case TRACE_DATA_STORE:
-		perform_access_store_data(c_data, addr, data_set_index, block_word_size, data_tag);
-		break;
+		owner_stats[cache_owner].evicted_others++;
+		owner_stats[owner].evicted_by_others++;
 	}
 }
+/************************************************************/
 
 /************************************************************/
-void perform_access(addr, access_type) 
-unsigned addr, access_type;
+/* record the lines each owner holds */
+void sample_occupancy()
 {
-	// handle the access to the cache
-	if (cache_split)
-	{// if data cache and instruction cache are used seperately
-		perform_access_split(&c1, &c2, addr, access_type);
-	}
-	else
-	{// if data cache and instruction cache are used integrally,
-		perform_access_unified(&c1, addr, access_type);
+	int i;
+
+	if (n_occ_samples == occ_samples_size)
+	{
+		occ_samples_size = occ_samples_size ? occ_samples_size * 2 : 64;
+		occ_samples = (int *)realloc(occ_samples, sizeof(int) * occ_samples_size * cache_owners);
 	}
+	for (i = 0; i < cache_owners; i++)
+		occ_samples[n_occ_samples * cache_owners + i] = owner_stats[i].lines;
+	n_occ_samples++;
 }
 /************************************************************/
 
 /************************************************************/
-void flush()
+void flush_instance(Pcache c)
 {
-	/* flush the cache */
 	int block_word_size = cache_block_size / WORD_SIZE;
-
 	Pcache_line cl;
-	for (int i = 0; i < c1.n_sets; i++)
+	Pcache_set set;
+	int i, n;
+
+	if (c->skew_lines)
 	{
-		cl = c1.LRU_head[i];
-		for (int j = 0; j < c1.set_contents[i]; j++)
+		for (i = 0; i < c->n_sets * c->associativity; i++)
 		{
-			if (cl->dirty)
+			if (c->skew_lines[i].valid && c->skew_lines[i].dirty)
+			{
 				cache_stat_data.copies_back += block_word_size;
-			cl = cl->LRU_next;
+				if (cache_emit)
+					emit_reference(TRACE_DATA_STORE, c->skew_lines[i].tag << c->index_mask_offset);
+			}
 		}
+		return;
 	}
 
-	if (cache_split)
+	n = c->sets ? c->n_sets : c->n_chunks * SET_CHUNK_SIZE;
+	for (i = 0; i < n; i++)
 	{
-		for (int j = 0; j < c2.n_sets; j++)
+		if (c->sets)
+			set = &c->sets[i];
+		else if (c->set_dir[i >> SET_CHUNK_BITS])
+			set = &c->set_dir[i >> SET_CHUNK_BITS][i & (SET_CHUNK_SIZE - 1)];
+		else
 		{
-			cl = c2.LRU_head[j];
-			for (int f = 0; f < c2.set_contents[j]; f++)
+			// untouched chunk, nothing to write back.
+			i |= SET_CHUNK_SIZE - 1;
+			continue;
+		}
+
+		for (cl = set->LRU_head; cl; cl = cl->LRU_next)
+		{
+			if (cl->dirty)
 			{
-				if (cl->dirty)
-					cache_stat_data.copies_back += block_word_size;
-				cl = cl->LRU_next; // move the node
+				cache_stat_data.copies_back += writeback_words(cl);
+				if (cache_emit)
+					emit_writeback(cl);
 			}
 		}
 	}
 }
 /************************************************************/
 
+/************************************************************/
+void flush()
+{
+	/* flush the cache */
+	flush_instance(&c1);
+	if (cache_split)
+		flush_instance(&c2);
+
+	/* and the write buffer behind it */
+	while (wbuf_count)
+		wbuf_pop();
+}
+/************************************************************/
+
+/************************************************************/
+/* free the sets and lines of one cache instance */
+void release_cache_instance(Pcache c)
+{
+	Pcache_line cl, next;
+	Pcache_set set;
+	int i, n;
+
+	n = c->sets ? c->n_sets : c->n_chunks * SET_CHUNK_SIZE;
+	for (i = 0; i < n; i++)
+	{
+		if (c->sets)
+			set = &c->sets[i];
+		else if (c->set_dir[i >> SET_CHUNK_BITS])
+			set = &c->set_dir[i >> SET_CHUNK_BITS][i & (SET_CHUNK_SIZE - 1)];
+		else
+		{
+			i |= SET_CHUNK_SIZE - 1;
+			continue;
+		}
+
+		// lines of an indexed fully-associative cache live in its arena
+		for (cl = set->LRU_head; cl && !c->fa_table; cl = next)
+		{
+			next = cl->LRU_next;
+			free(cl);
+		}
+		free(set->heap);
+	}
+
+	if (c->set_dir)
+		for (i = 0; i < c->n_chunks; i++)
+			free(c->set_dir[i]);
+	free(c->set_dir);
+	free(c->sets);
+	free(c->skew_lines);
+	free(c->fa_table);
+	if (c->fa_table)
+		free(c->line_arena);
+	free(c->mshrs);
+	free(c->set_stats);
+	memset(c, 0, sizeof(cache));
+}
+/************************************************************/
+
+/************************************************************/
+/* free everything init_cache allocated, so a long running process can
+   simulate one configuration after another */
+void release_cache()
+{
+	release_cache_instance(&c1);
+	if (cache_split)
+		release_cache_instance(&c2);
+	free(wbuf);
+	wbuf = NULL;
+	free(owner_stats);
+	owner_stats = NULL;
+	free(occ_samples);
+	occ_samples = NULL;
+	occ_samples_size = 0;
+	memset(repeat_line, 0, sizeof(repeat_line));
+	for (int i = 0; region_dir && i < n_region_chunks; i++)
+		free(region_dir[i]);
+	free(region_dir);
+	region_dir = NULL;
+}
+/************************************************************/
+
+/************************************************************/
+/* copy the configuration of this thread out, or into this thread */
+void save_cache_params(p)
+Pcache_params p;
+{
+	p->split = cache_split;
+	p->usize = cache_usize;
+	p->isize = cache_isize;
+	p->dsize = cache_dsize;
+	p->block_size = cache_block_size;
+	p->assoc = cache_assoc;
+	p->writeback = cache_writeback;
+	p->writealloc = cache_writealloc;
+	p->mshrs = cache_mshrs;
+	p->fill_latency = cache_fill_latency;
+	p->index_hash = cache_index_hash;
+	p->sector_size = cache_sector_size;
+	p->wbuf_entries = cache_wbuf_entries;
+	p->wbuf_drain = cache_wbuf_drain;
+	p->wbuf_bypass = cache_wbuf_bypass;
+	p->partitioned = cache_partitioned;
+	memcpy(p->class_ways, class_ways, sizeof(class_ways));
+	memcpy(p->class_configured, class_configured, sizeof(class_configured));
+}
+
+void load_cache_params(p)
+Pcache_params p;
+{
+	cache_split = p->split;
+	cache_usize = p->usize;
+	cache_isize = p->isize;
+	cache_dsize = p->dsize;
+	cache_block_size = p->block_size;
+	words_per_block = p->block_size / WORD_SIZE;
+	cache_assoc = p->assoc;
+	cache_writeback = p->writeback;
+	cache_writealloc = p->writealloc;
+	cache_mshrs = p->mshrs;
+	cache_fill_latency = p->fill_latency;
+	cache_index_hash = p->index_hash;
+	cache_sector_size = p->sector_size;
+	cache_wbuf_entries = p->wbuf_entries;
+	cache_wbuf_drain = p->wbuf_drain;
+	cache_wbuf_bypass = p->wbuf_bypass;
+	cache_partitioned = p->partitioned;
+	memcpy(class_ways, p->class_ways, sizeof(class_ways));
+	memcpy(class_configured, p->class_configured, sizeof(class_configured));
+}
+/************************************************************/
+
+/************************************************************/
+/* copy out the statistics print_stats reports */
+void get_cache_stats(inst, data)
+Pcache_stat inst, data;
+{
+	*inst = cache_stat_inst;
+	*data = cache_stat_data;
+}
+
+/* misses of both streams so far, a change tells an access missed */
+long long get_cache_misses()
+{
+	return cache_stat_inst.misses + cache_stat_data.misses;
+}
+/************************************************************/
+
 /************************************************************/
 void delete (head, tail, item)
 	Pcache_line *head,
@@ -596,10 +1693,24 @@ Pcache_line item;
 void set_cache_param(param, value) int param;
 int value;
 {
+	// sizes and associativity need not be powers of two, only positive.
+	// whether they make whole sets is checked once all are known, in
+	// init_cache_instance.
+	if ((param == CACHE_PARAM_USIZE || param == CACHE_PARAM_ISIZE ||
+		 param == CACHE_PARAM_DSIZE || param == CACHE_PARAM_ASSOC) && value < 1)
+	{
+		printf("error set_cache_param: cache sizes and associativity must be positive\n");
+		exit(-1);
+	}
 
 	switch (param)
 	{
 	case CACHE_PARAM_BLOCK_SIZE:
+		if (value < WORD_SIZE || (value & (value - 1)))
+		{
+			printf("error set_cache_param: block size must be a power of two of at least %d\n", WORD_SIZE);
+			exit(-1);
+		}
 		cache_block_size = value;
 		words_per_block = value / WORD_SIZE;
 		break;
@@ -630,6 +1741,77 @@ int value;
 	case CACHE_PARAM_NOWRITEALLOC:
 		cache_writealloc = 0;
 		break;
+	case CACHE_PARAM_WBUF_ENTRIES:
+		if (value < 0)
+		{
+			printf("error set_cache_param: write buffer entries must not be negative\n");
+			exit(-1);
+		}
+		cache_wbuf_entries = value;
+		break;
+	case CACHE_PARAM_WBUF_DRAIN:
+		if (value < 1)
+		{
+			printf("error set_cache_param: write buffer drain time must be positive\n");
+			exit(-1);
+		}
+		cache_wbuf_drain = value;
+		break;
+	case CACHE_PARAM_WBUF_BYPASS:
+		cache_wbuf_bypass = TRUE;
+		break;
+	case CACHE_PARAM_OPT:
+		cache_opt = value;
+		break;
+	case CACHE_PARAM_EMIT:
+		cache_emit = value;
+		break;
+	case CACHE_PARAM_HOTSPOTS:
+		if (value < 0)
+		{
+			printf("error set_cache_param: region size must not be negative\n");
+			exit(-1);
+		}
+		cache_region_size = value;
+		break;
+	case CACHE_PARAM_OWNERS:
+		if (value < 1)
+		{
+			printf("error set_cache_param: need at least one trace\n");
+			exit(-1);
+		}
+		cache_owners = value;
+		break;
+	case CACHE_PARAM_OCCUPANCY_INTERVAL:
+		cache_occ_interval = value;
+		break;
+	case CACHE_PARAM_SECTOR_SIZE:
+		if (value < WORD_SIZE || (value & (value - 1)))
+		{
+			printf("error set_cache_param: sector size must be a power of two of at least %d\n", WORD_SIZE);
+			exit(-1);
+		}
+		cache_sector_size = value;
+		break;
+	case CACHE_PARAM_INDEX_HASH:
+		cache_index_hash = value;
+		break;
+	case CACHE_PARAM_MSHRS:
+		if (value < 0 || value > MAX_CACHE_MSHRS)
+		{
+			printf("error set_cache_param: MSHR count must be 0..%d\n", MAX_CACHE_MSHRS);
+			exit(-1);
+		}
+		cache_mshrs = value;
+		break;
+	case CACHE_PARAM_FILL_LATENCY:
+		if (value < 1)
+		{
+			printf("error set_cache_param: fill latency must be positive\n");
+			exit(-1);
+		}
+		cache_fill_latency = value;
+		break;
 	default:
 		printf("error set_cache_param: bad parameter value\n");
 		exit(-1);
@@ -637,6 +1819,16 @@ int value;
 }
 /************************************************************/
 
+/************************************************************/
+/* bytes mapped by one way of the largest cache, used for page coloring */
+int cache_way_size()
+{
+	int size = cache_split ? (cache_isize > cache_dsize ? cache_isize : cache_dsize) : cache_usize;
+
+	return size / cache_assoc;
+}
+/************************************************************/
+
 /************************************************************/
 void dump_settings()
 {
@@ -658,6 +1850,23 @@ void dump_settings()
 		   cache_writeback ? "WRITE BACK" : "WRITE THROUGH");
 	printf("  Allocation policy: \t%s\n",
 		   cache_writealloc ? "WRITE ALLOCATE" : "WRITE NO ALLOCATE");
+	if (cache_sector_size && cache_sector_size != cache_block_size)
+		printf("  Sector size: \t%d\n", cache_sector_size);
+	if (cache_index_hash != INDEX_HASH_PLAIN)
+	{
+		static const char *hash_name[] = { "PLAIN", "XOR FOLD", "PRIME MODULO", "SKEWED" };
+		printf("  Index function: \t%s\n", hash_name[cache_index_hash]);
+	}
+	if (cache_wbuf_entries)
+	{
+		printf("  Write buffer: \t%d entries, %d cycles per drain%s\n", cache_wbuf_entries,
+			   cache_wbuf_drain, cache_wbuf_bypass ? ", read bypass" : "");
+	}
+	if (cache_mshrs)
+	{
+		printf("  MSHRs: \t%d\n", cache_mshrs);
+		printf("  Fill latency: \t%d\n", cache_fill_latency);
+	}
 }
 /************************************************************/
 
@@ -667,31 +1876,345 @@ void print_stats()
 	printf("\n*** CACHE STATISTICS ***\n");
 
 	printf(" INSTRUCTIONS\n");
-	printf("  accesses:  %d\n", cache_stat_inst.accesses);
-	printf("  misses:    %d\n", cache_stat_inst.misses);
+	printf("  accesses:  %lld\n", cache_stat_inst.accesses);
+	printf("  misses:    %lld\n", cache_stat_inst.misses);
 	if (!cache_stat_inst.accesses)
 		printf("  miss rate: 0 (0)\n");
 	else
 		printf("  miss rate: %2.4f (hit rate %2.4f)\n",
 			   (float)cache_stat_inst.misses / (float)cache_stat_inst.accesses,
 			   1.0 - (float)cache_stat_inst.misses / (float)cache_stat_inst.accesses);
-	printf("  replace:   %d\n", cache_stat_inst.replacements);
+	printf("  replace:   %lld\n", cache_stat_inst.replacements);
 
 	printf(" DATA\n");
-	printf("  accesses:  %d\n", cache_stat_data.accesses);
-	printf("  misses:    %d\n", cache_stat_data.misses);
+	printf("  accesses:  %lld\n", cache_stat_data.accesses);
+	printf("  misses:    %lld\n", cache_stat_data.misses);
 	if (!cache_stat_data.accesses)
 		printf("  miss rate: 0 (0)\n");
 	else
 		printf("  miss rate: %2.4f (hit rate %2.4f)\n",
 			   (float)cache_stat_data.misses / (float)cache_stat_data.accesses,
 			   1.0 - (float)cache_stat_data.misses / (float)cache_stat_data.accesses);
-	printf("  replace:   %d\n", cache_stat_data.replacements);
+	printf("  replace:   %lld\n", cache_stat_data.replacements);
 
 	printf(" TRAFFIC (in words)\n");
-	printf("  demand fetch:  %d\n", cache_stat_inst.demand_fetches +
+	printf("  demand fetch:  %lld\n", cache_stat_inst.demand_fetches +
 										cache_stat_data.demand_fetches);
-	printf("  copies back:   %d\n", cache_stat_inst.copies_back +
+	printf("  copies back:   %lld\n", cache_stat_inst.copies_back +
 										cache_stat_data.copies_back);
+	if (cache_sectors > 1)
+		printf("  sector misses: %lld\n", cache_stat_inst.sector_misses +
+											cache_stat_data.sector_misses);
+
+	if (cache_wbuf_entries)
+	{
+		printf(" WRITE BUFFER\n");
+		printf("  memory writes: %lld\n", wbuf_stats.writes);
+		printf("  coalesced:     %lld\n", wbuf_stats.coalesced);
+		printf("  full stalls:   %lld\n", wbuf_stats.full_stalls);
+		printf("  raw stalls:    %lld\n", wbuf_stats.raw_stalls);
+		printf("  raw bypasses:  %lld\n", wbuf_stats.raw_bypasses);
+		printf("  stall cycles:  %lld\n", wbuf_stats.stall_cycles);
+	}
+
+	if (cache_mshrs)
+	{
+		printf(" TIMING\n");
+		printf("  cycles:        %llu\n", cache_cycle);
+		printf("  secondary:     %lld\n", cache_stat_inst.secondary_misses +
+											cache_stat_data.secondary_misses);
+		printf("  mshr stalls:   %lld (%lld cycles)\n",
+			   cache_stat_inst.mshr_stalls + cache_stat_data.mshr_stalls,
+			   cache_stat_inst.stall_cycles + cache_stat_data.stall_cycles);
+		printf("  miss busy:     %.0f\n", mshr_busy_cycles);
+		if (mshr_busy_cycles == 0)
+			printf("  MLP:           0\n");
+		else
+			printf("  MLP:           %2.4f\n", mshr_fill_cycles / mshr_busy_cycles);
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* per class statistics of a way-partitioned cache */
+void print_class_stats()
+{
+	Pcache_stat cs;
+	int i;
+
+	if (!cache_partitioned)
+		return;
+
+	printf("\n*** PER-CLASS STATISTICS ***\n");
+	for (i = 0; i < MAX_CACHE_CLASSES; i++)
+	{
+		cs = &class_stats[i];
+		if (!cs->accesses && !class_configured[i])
+			continue;
+		printf(" CLASS %d (ways 0x%llx)\n", i, class_ways[i] & c1.all_ways);
+		printf("  accesses:  %lld\n", cs->accesses);
+		printf("  misses:    %lld\n", cs->misses);
+		if (!cs->accesses)
+			printf("  miss rate: 0 (0)\n");
+		else
+			printf("  miss rate: %2.4f (hit rate %2.4f)\n",
+				   (float)cs->misses / (float)cs->accesses,
+				   1.0 - (float)cs->misses / (float)cs->accesses);
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* per trace statistics of a shared cache run */
+void print_owner_stats(names)
+char **names;
+{
+	Powner_stat o;
+	int i, j;
+
+	if (cache_owners == 1)
+		return;
+
+	printf("\n*** PER-TRACE STATISTICS ***\n");
+	for (i = 0; i < cache_owners; i++)
+	{
+		o = &owner_stats[i];
+		printf(" TRACE %d (%s)\n", i, names[i]);
+		printf("  accesses:  %lld\n", o->accesses);
+		printf("  misses:    %lld\n", o->misses);
+		if (!o->accesses)
+			printf("  miss rate: 0 (0)\n");
+		else
+			printf("  miss rate: %2.4f (hit rate %2.4f)\n",
+				   (float)o->misses / (float)o->accesses,
+				   1.0 - (float)o->misses / (float)o->accesses);
+		printf("  evicted others:    %lld\n", o->evicted_others);
+		printf("  evicted by others: %lld\n", o->evicted_by_others);
+		printf("  resident lines:    %d\n", o->lines);
+	}
+
+	if (n_occ_samples)
+	{
+		printf(" OCCUPANCY (lines per trace every %d references)\n", cache_occ_interval);
+		for (i = 0; i < n_occ_samples; i++)
+		{
+			printf("  %lld", (i + 1) * (long long)cache_occ_interval);
+			for (j = 0; j < cache_owners; j++)
+				printf("\t%d", occ_samples[i * cache_owners + j]);
+			printf("\n");
+		}
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* most misses first, then the lowest index */
+int hotter(const void *a, const void *b)
+{
+	Phot_key x = (Phot_key)a, y = (Phot_key)b;
+
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* how many of the ranked keys it takes to cover half of total */
+int half_of(Phot_key keys, int n, unsigned long long total)
+{
+	unsigned long long sum = 0;
+	int i;
+
+	for (i = 0; i < n && 2 * sum < total; i++)
+		sum += keys[i].count;
+	return i;
+}
+
+void print_set_hotspots(Pcache c, char *name, int top)
+{
+	Phot_key keys = (Phot_key)malloc(sizeof(hot_key) * c->n_sets);
+	unsigned long long total = 0;
+	Pset_stat st;
+	int i, n = 0;
+
+	for (i = 0; i < c->n_sets; i++)
+		if (c->set_stats[i].misses)
+		{
+			keys[n].count = c->set_stats[i].misses;
+			keys[n++].index = i;
+			total += c->set_stats[i].misses;
+		}
+	qsort(keys, n, sizeof(hot_key), hotter);
+
+	printf(" %s SETS (%d)\n", name, c->n_sets);
+	printf("  sets missing: \t%d\n", n);
+	printf("  half the misses in: \t%d sets\n", half_of(keys, n, total));
+	printf("  %-8s %10s %10s %10s %10s\n", "set", "accesses", "misses", "evictions", "dirty");
+	for (i = 0; i < n && i < top; i++)
+	{
+		st = &c->set_stats[keys[i].index];
+		printf("  %-8u %10llu %10llu %10llu %10llu\n", keys[i].index, st->accesses, st->misses,
+			   st->evictions, st->dirty_evictions);
+	}
+	free(keys);
+}
+
+/* the sets and address regions that take the most misses */
+void print_hotspots(top)
+int top;
+{
+	Phot_key keys;
+	unsigned long long total = 0;
+	unsigned long long *chunk;
+	int i, j, n = 0, size = 0;
+
+	if (!cache_region_size)
+		return;
+
+	printf("\n*** HOTSPOTS ***\n");
+	if (cache_split)
+	{
+		print_set_hotspots(&c2, "INSTRUCTION", top);
+		print_set_hotspots(&c1, "DATA", top);
+	}
+	else
+		print_set_hotspots(&c1, "UNIFIED", top);
+
+	keys = NULL;
+	for (i = 0; i < n_region_chunks; i++)
+		for (j = 0, chunk = region_dir[i]; chunk && j < SET_CHUNK_SIZE; j++)
+		{
+			if (!chunk[j])
+				continue;
+			if (n == size)
+			{
+				size = size ? 2 * size : SET_CHUNK_SIZE;
+				keys = (Phot_key)realloc(keys, sizeof(hot_key) * size);
+			}
+			keys[n].count = chunk[j];
+			keys[n++].index = (unsigned)i << SET_CHUNK_BITS | j;
+			total += chunk[j];
+		}
+	qsort(keys, n, sizeof(hot_key), hotter);
+
+	printf(" REGIONS (%d bytes)\n", cache_region_size);
+	printf("  regions missing: \t%d\n", n);
+	printf("  half the misses in: \t%d regions\n", half_of(keys, n, total));
+	printf("  %-12s %10s\n", "address", "misses");
+	for (i = 0; i < n && i < top; i++)
+		printf("  0x%08x   %10llu\n", keys[i].index * cache_region_size, keys[i].count);
+	free(keys);
+}
+/************************************************************/
+
+/************************************************************/
+void put_word(FILE *f, unsigned w)
+{
+	unsigned char bytes[4];
+
+	bytes[0] = w;
+	bytes[1] = w >> 8;
+	bytes[2] = w >> 16;
+	bytes[3] = w >> 24;
+	fwrite(bytes, 1, 4, f);
+}
+
+void put_count(FILE *f, unsigned long long n)
+{
+	put_word(f, (unsigned)n);
+	put_word(f, (unsigned)(n >> 32));
+}
+
+void write_set_hotspots(FILE *f, Pcache c, char *name, int csv)
+{
+	Pset_stat st;
+	int i, n = 0;
+
+	if (!csv)
+	{
+		for (i = 0; i < c->n_sets; i++)
+			n += c->set_stats[i].accesses != 0;
+		put_word(f, name[0]);
+		put_word(f, c->n_sets);
+		put_word(f, n);
+	}
+	for (i = 0; i < c->n_sets; i++)
+	{
+		st = &c->set_stats[i];
+		if (!st->accesses)
+			continue;
+		if (csv)
+			fprintf(f, "set,%c,%d,,%llu,%llu,%llu,%llu\n", name[0], i, st->accesses, st->misses,
+					st->evictions, st->dirty_evictions);
+		else
+		{
+			put_word(f, i);
+			put_count(f, st->accesses);
+			put_count(f, st->misses);
+			put_count(f, st->evictions);
+			put_count(f, st->dirty_evictions);
+		}
+	}
+}
+
+/* dump the counters of every referenced set and every region that
+   missed, as CSV when the name ends in .csv */
+int write_hotspots(name)
+char *name;
+{
+	unsigned char header[8];
+	int csv = strlen(name) > 4 && !strcmp(name + strlen(name) - 4, ".csv");
+	unsigned long long *chunk;
+	unsigned region;
+	int i, j, n = 0;
+	FILE *f;
+
+	if (!cache_region_size)
+		return 1;
+	f = fopen(name, csv ? "w" : "wb");
+	if (!f)
+		return 0;
+
+	if (csv)
+		fprintf(f, "kind,cache,index,address,accesses,misses,evictions,dirty_evictions\n");
+	else
+	{
+		memset(header, 0, sizeof(header));
+		memcpy(header, HOTSPOT_MAGIC, 4);
+		header[4] = HOTSPOT_VERSION;
+		fwrite(header, 1, sizeof(header), f);
+		put_word(f, cache_split ? 2 : 1);
+	}
+	if (cache_split)
+	{
+		write_set_hotspots(f, &c2, "I", csv);
+		write_set_hotspots(f, &c1, "D", csv);
+	}
+	else
+		write_set_hotspots(f, &c1, "U", csv);
+
+	if (!csv)
+	{
+		for (i = 0; i < n_region_chunks; i++)
+			for (j = 0; region_dir[i] && j < SET_CHUNK_SIZE; j++)
+				n += region_dir[i][j] != 0;
+		put_word(f, cache_region_size);
+		put_word(f, n);
+	}
+	for (i = 0; i < n_region_chunks; i++)
+		for (j = 0, chunk = region_dir[i]; chunk && j < SET_CHUNK_SIZE; j++)
+		{
+			if (!chunk[j])
+				continue;
+			region = (unsigned)i << SET_CHUNK_BITS | j;
+			if (csv)
+				fprintf(f, "region,,%u,0x%08x,,%llu,,\n", region, region * cache_region_size, chunk[j]);
+			else
+			{
+				put_word(f, region);
+				put_count(f, chunk[j]);
+			}
+		}
+	fclose(f);
+	return 1;
 }
 /************************************************************/
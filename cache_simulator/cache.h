@@ -15,6 +15,37 @@
 #define DEFAULT_CACHE_ASSOC 1
 #define DEFAULT_CACHE_WRITEBACK TRUE
 #define DEFAULT_CACHE_WRITEALLOC TRUE
+#define DEFAULT_CACHE_MSHRS 0		/* 0 = blocking cache, no timing model */
+#define DEFAULT_CACHE_FILL_LATENCY 100
+#define MAX_CACHE_MSHRS 64
+#define MAX_CACHE_SECTORS 64		/* sectors per block, one bit each */
+#define DEFAULT_WBUF_DRAIN 4		/* cycles to write one buffer entry */
+#define MAX_CACHE_CLASSES 16		/* classes of service for way partitioning */
+
+/* caches with more sets keep them in chunks allocated on first touch */
+#define SPARSE_SET_THRESHOLD (64 * 1024)
+#define SET_CHUNK_BITS 10
+#define SET_CHUNK_SIZE (1 << SET_CHUNK_BITS)
+
+/* the hotspot dump is CSV, or when not named .csv a binary file of the
+   trace header layout, then little-endian 32 bit words: the number of
+   caches, per cache its name, set count and record count, then set,
+   accesses, misses, evictions and dirty evictions of each set referenced;
+   last the region size and record count, then region and misses of each
+   region that missed. Counts take two words, low word first. */
+#define HOTSPOT_MAGIC "\x89MHS"
+#define HOTSPOT_VERSION 2
+
+/* fully-associative caches at least this wide use a tag hash index */
+#define FA_INDEX_MIN_ASSOC 16
+
+/* the simulator state lives in thread-local storage, so a server can run
+   several configurations at once, one per thread */
+#ifdef _MSC_VER
+#define SIM_TLS __declspec(thread)
+#else
+#define SIM_TLS __thread
+#endif
 
 /* constants for settting cache parameters */
 #define CACHE_PARAM_BLOCK_SIZE 0
@@ -26,40 +57,176 @@
 #define CACHE_PARAM_WRITETHROUGH 6
 #define CACHE_PARAM_WRITEALLOC 7
 #define CACHE_PARAM_NOWRITEALLOC 8
+#define CACHE_PARAM_MSHRS 9
+#define CACHE_PARAM_FILL_LATENCY 10
+#define CACHE_PARAM_INDEX_HASH 11
+#define CACHE_PARAM_SECTOR_SIZE 12
+#define CACHE_PARAM_WBUF_ENTRIES 13
+#define CACHE_PARAM_WBUF_DRAIN 14
+#define CACHE_PARAM_WBUF_BYPASS 15
+#define CACHE_PARAM_OWNERS 16
+#define CACHE_PARAM_OCCUPANCY_INTERVAL 17
+#define CACHE_PARAM_OPT 18
+#define CACHE_PARAM_EMIT 19
+#define CACHE_PARAM_HOTSPOTS 20	/* region size of the miss histogram, 0 = off */
+
+/* set index functions */
+#define INDEX_HASH_PLAIN 0		/* address bit slice */
+#define INDEX_HASH_XOR 1		/* xor-fold of all upper address bits */
+#define INDEX_HASH_PRIME 2		/* block address modulo a prime */
+#define INDEX_HASH_SKEW 3		/* skewed-associative, one hash per way */
+#define INDEX_HASH_MODULO 4		/* block address modulo a non power of two set count */
 
 
 /* structure definitions */
 typedef struct cache_line_ {
   unsigned tag;
   int dirty;
+  int owner;			/* trace that brought the line in */
+  int way;			/* way the line occupies, when partitioned */
+  unsigned long long next_use;	/* next reference to the block (OPT) */
+  int heap_pos;			/* position in the set's OPT heap */
+  unsigned long long valid_sectors;	/* fetched sectors of the block */
+  unsigned long long dirty_sectors;	/* written sectors of the block */
   
   int address;
-  unsigned int timestamp;
+  unsigned long long timestamp;	/* cycle the fill of this line completes */
 
   struct cache_line_ *LRU_next;
   struct cache_line_ *LRU_prev;
 } cache_line, *Pcache_line;
 
+typedef struct cache_set_ {
+  Pcache_line LRU_head;		/* head of LRU list */
+  Pcache_line LRU_tail;		/* tail of LRU list */
+  int contents;			/* number of valid entries in set */
+  unsigned long long ways_used;	/* occupied ways, when partitioned */
+  Pcache_line *heap;		/* max-heap on next use (OPT) */
+} cache_set, *Pcache_set;
+
+typedef struct skew_line_ {
+  unsigned tag;			/* block address */
+  unsigned long long lru;	/* last use, larger is more recent */
+  int valid;
+  int dirty;
+  int owner;			/* trace that brought the line in */
+} skew_line, *Pskew_line;
+
+/* division by an invariant divisor through a multiply and shifts */
+typedef struct fastdiv_ {
+  unsigned divisor;
+  unsigned multiplier;
+  int shift1;
+  int shift2;
+} fastdiv, *Pfastdiv;
+
+typedef struct wbuf_entry_ {
+  unsigned block;		/* block address of the combined stores */
+  unsigned long long words;	/* written words of the block */
+} wbuf_entry, *Pwbuf_entry;
+
+typedef struct wbuf_stat_ {
+  long long writes;		/* entries written to memory */
+  long long coalesced;		/* stores combined into a pending entry */
+  long long full_stalls;	/* stores stalled on a full buffer */
+  long long raw_stalls;		/* fills that waited for a pending store */
+  long long raw_bypasses;	/* fills forwarded from a pending store */
+  long long stall_cycles;	/* cycles spent in either kind of stall */
+} wbuf_stat, *Pwbuf_stat;
+
+typedef struct owner_stat_ {
+  long long accesses;		/* references of this trace */
+  long long misses;		/* misses of this trace */
+  long long evicted_others;	/* lines of other traces it evicted */
+  long long evicted_by_others;	/* lines of it other traces evicted */
+  int lines;			/* lines it currently holds */
+} owner_stat, *Powner_stat;
+
+/* conflict counters of one set, when hotspots are counted */
+typedef struct set_stat_ {
+  unsigned long long accesses;
+  unsigned long long misses;
+  unsigned long long evictions;
+  unsigned long long dirty_evictions;
+} set_stat, *Pset_stat;
+
+/* a set or region ranked by its misses */
+typedef struct hot_key_ {
+  unsigned long long count;
+  unsigned index;
+} hot_key, *Phot_key;
+
+typedef struct mshr_ {
+  unsigned block;		/* block address being filled */
+  unsigned long long ready;	/* cycle the fill completes */
+} mshr, *Pmshr;
+
 typedef struct cache_ {
   int size;			/* cache size */
   int associativity;		/* cache associativity */
   int n_sets;			/* number of cache sets */
   unsigned index_mask;		/* mask to find cache index */
   int index_mask_offset;	/* number of zero bits in mask */
-  Pcache_line *LRU_head;	/* head of LRU list for each set */
-  Pcache_line *LRU_tail;	/* tail of LRU list for each set */
-  int *set_contents;		/* number of valid entries in set */
+  Pcache_set sets;		/* flat set array, or 0 when sparse */
+  Pcache_set *set_dir;		/* chunk directory of a sparse cache */
+  int n_chunks;			/* number of chunks in set_dir */
+  int chunks_touched;		/* number of chunks allocated so far */
   int contents;			/* number of valid entries in cache */
+  Pset_stat set_stats;		/* per-set counters, or 0 */
 
   int block_bit_num;     /* number of block bits */
+  int set_bits;			/* number of index bits, rounded up */
+  int pow2_sets;		/* n_sets is a power of two */
+  int index_hash;		/* set index function */
+  fastdiv set_div;		/* divisor of the prime modulo index */
+  unsigned long long all_ways;	/* mask of every way of the cache */
+
+  Pskew_line skew_lines;	/* way-major lines of a skewed cache */
+  unsigned long long skew_clock;	/* LRU clock of a skewed cache */
+
+  Pcache_line *fa_table;	/* tag hash of a fully-associative cache */
+  int fa_bits;			/* log2 of the fa_table size */
+  Pcache_line line_arena;	/* lines of a fully-associative cache */
+  Pcache_line free_lines;	/* unused lines in line_arena */
+
+  Pmshr mshrs;			/* outstanding misses (timing mode) */
+  int n_mshrs_busy;		/* number of allocated MSHRs */
 } cache, *Pcache;
 
+/* the configuration set_cache_param builds, to hand to another thread */
+typedef struct cache_params_ {
+  int split;
+  int usize;
+  int isize;
+  int dsize;
+  int block_size;
+  int assoc;
+  int writeback;
+  int writealloc;
+  int mshrs;
+  int fill_latency;
+  int index_hash;
+  int sector_size;
+  int wbuf_entries;
+  int wbuf_drain;
+  int wbuf_bypass;
+  int partitioned;
+  unsigned long long class_ways[MAX_CACHE_CLASSES];
+  int class_configured[MAX_CACHE_CLASSES];
+} cache_params, *Pcache_params;
+
 typedef struct cache_stat_ {
-  int accesses;			/* number of memory references */
-  int misses;			/* number of cache misses */
-  int replacements;		/* number of misses that cause replacments */
-  int demand_fetches;		/* number of fetches */
-  int copies_back;		/* number of write backs */
+  long long accesses;		/* number of memory references */
+  long long misses;		/* number of cache misses */
+  long long replacements;	/* number of misses that cause replacments */
+  long long demand_fetches;	/* number of fetches */
+  long long copies_back;	/* number of write backs */
+
+  long long sector_misses;	/* misses on a present tag, missing sector */
+
+  long long secondary_misses;	/* misses merged into an in-flight MSHR */
+  long long mshr_stalls;	/* misses stalled on a full MSHR file */
+  long long stall_cycles;	/* cycles spent waiting for a free MSHR */
 } cache_stat, *Pcache_stat;
 
 
@@ -67,11 +234,30 @@ typedef struct cache_stat_ {
 void set_cache_param();
 void init_cache();
 void perform_access();
+void perform_repeat();
 void flush();
+void release_cache();
+void get_cache_stats();
+long long get_cache_misses();
+void save_cache_params();
+void load_cache_params();
 void delete();
 void insert();
 void dump_settings();
 void print_stats();
+int cache_way_size();
+void set_cache_owner();
+void set_cache_next_use();
+unsigned cache_block_key();
+void set_cache_class();
+void set_class_ways();
+void print_class_stats();
+void print_owner_stats();
+void print_hotspots();
+int write_hotspots();
+void fastdiv_init();
+unsigned fastdiv_div();
+unsigned fastdiv_mod();
 
 
 /* macros */
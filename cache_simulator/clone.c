@@ -0,0 +1,664 @@
+/*
+ * clone.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cache.h"
+#include "main.h"
+#include "opt.h"
+#include "trace.h"
+#include "clone.h"
+
+
+/************************************************************/
+static void stack_init(s, size)
+Pclone_stack s;
+long long size;
+{
+	s->size = size;
+	s->word = (unsigned*)malloc(sizeof(unsigned) * size);
+	s->tree = (int*)calloc(size + 1, sizeof(int));
+	s->now = 0;
+	s->live = 0;
+}
+
+static void stack_free(s)
+Pclone_stack s;
+{
+	free(s->word);
+	free(s->tree);
+}
+
+static void pages_init(p)
+Pclone_pages p;
+{
+	p->touched = (unsigned char*)calloc(CLONE_PAGES / 8, 1);
+	p->list = (unsigned*)malloc(sizeof(unsigned) * CLONE_PAGES);
+	p->n = 0;
+}
+
+static void pages_free(p)
+Pclone_pages p;
+{
+	free(p->touched);
+	free(p->list);
+}
+
+/* note a touch of page, returns TRUE the first time */
+static int touch_page(p, page)
+Pclone_pages p;
+unsigned page;
+{
+	if (p->touched[page / 8] & (1 << page % 8))
+		return FALSE;
+	p->touched[page / 8] |= 1 << page % 8;
+	p->list[p->n++] = page;
+	return TRUE;
+}
+
+static void granules_init(gr)
+Pclone_granules gr;
+{
+	gr->size = CLONE_GRANULES_START;
+	gr->key = (unsigned*)calloc(gr->size, sizeof(unsigned));
+	gr->last = (long long*)malloc(sizeof(long long) * gr->size);
+	gr->off = (unsigned char*)malloc(gr->size);
+	gr->n = 0;
+}
+
+static void granules_free(gr)
+Pclone_granules gr;
+{
+	free(gr->key);
+	free(gr->last);
+	free(gr->off);
+}
+
+/* the slot of key, added with no time of last use when it is new. The
+   table doubles once half full. */
+static size_t granule_slot(gr, key)
+Pclone_granules gr;
+unsigned key;
+{
+	clone_granules old;
+	size_t h, i;
+
+	if (2 * gr->n >= gr->size) {
+		old = *gr;
+		gr->size *= 2;
+		gr->key = (unsigned*)calloc(gr->size, sizeof(unsigned));
+		gr->last = (long long*)malloc(sizeof(long long) * gr->size);
+		gr->off = (unsigned char*)malloc(gr->size);
+		for (i = 0; i < old.size; i++)
+			if (old.key[i]) {
+				for (h = (size_t)(old.key[i] * 2654435761u) & (gr->size - 1); gr->key[h]; h = (h + 1) & (gr->size - 1))
+					;
+				gr->key[h] = old.key[i];
+				gr->last[h] = old.last[i];
+				gr->off[h] = old.off[i];
+			}
+		granules_free(&old);
+	}
+	for (h = (size_t)(key * 2654435761u) & (gr->size - 1); gr->key[h] && gr->key[h] != key; h = (h + 1) & (gr->size - 1))
+		;
+	if (!gr->key[h]) {
+		gr->key[h] = key;
+		gr->last[h] = -1;
+		gr->n++;
+	}
+	return h;
+}
+
+static void stack_add(s, t, delta)
+Pclone_stack s;
+long long t;
+int delta;
+{
+	for (t++; t <= s->size; t += t & -t)
+		s->tree[t] += delta;
+	s->live += delta;
+}
+
+/* number of current times at or before t */
+static long long stack_count(s, t)
+Pclone_stack s;
+long long t;
+{
+	long long n = 0;
+
+	for (t++; t > 0; t -= t & -t)
+		n += s->tree[t];
+	return n;
+}
+
+/* the time of the word at LRU depth d, 0 being the most recent */
+static long long stack_find(s, d)
+Pclone_stack s;
+int d;
+{
+	long long t = 0, step, k = s->live - d;
+
+	for (step = 1; step * 2 <= s->size; step *= 2)
+		;
+	for (; step; step /= 2)
+		if (t + step <= s->size && s->tree[t + step] < k) {
+			t += step;
+			k -= s->tree[t];
+		}
+	return t;
+}
+
+/* keep the CLONE_MAX_DEPTH most recent granules of a full stack and move
+   them to the first times. A stack more than half full after that grows,
+   so the tree stays as small as the footprint allows. */
+static void stack_compact(s)
+Pclone_stack s;
+{
+	long long t, k = 0, skip = s->live - CLONE_MAX_DEPTH;
+
+	for (t = 0; t < s->now; t++)
+		if (s->word[t] != CLONE_NO_WORD && skip-- <= 0)
+			s->word[k++] = s->word[t];
+	if (k > s->size / 2 && s->size < 2 * CLONE_MAX_DEPTH) {
+		s->size *= 2;
+		s->word = (unsigned*)realloc(s->word, sizeof(unsigned) * s->size);
+		s->tree = (int*)realloc(s->tree, sizeof(int) * (s->size + 1));
+	}
+	memset(s->tree, 0, sizeof(int) * (s->size + 1));
+	s->live = 0;
+	for (t = 0; t < k; t++)
+		stack_add(s, t, 1);
+	s->now = k;
+}
+/************************************************************/
+
+/************************************************************/
+/* stack depth d to its bucket, exact below 4 and then 4 buckets per
+   power of two */
+static int depth_bucket(d)
+int d;
+{
+	int b;
+
+	if (d < 4)
+		return d;
+	for (b = 2; d >> (b + 1); b++)
+		;
+	return 4 * (b - 1) + ((d >> (b - 2)) & 3);
+}
+
+static int bucket_low(k)
+int k;
+{
+	return k < 4 ? k : (4 + k % 4) << (k / 4 - 1);
+}
+
+static int bucket_width(k)
+int k;
+{
+	return k < 4 ? 1 : 1 << (k / 4 - 1);
+}
+/************************************************************/
+
+/************************************************************/
+/* the stride from the previous new granule when it is short enough to
+   be a scan, else 0 */
+static int scan_stride(g, prev)
+unsigned g, prev;
+{
+	long long stride = (long long)g - prev;
+
+	return stride >= -CLONE_MAX_STRIDE && stride <= CLONE_MAX_STRIDE ? (int)stride : 0;
+}
+/************************************************************/
+
+/************************************************************/
+/* measure the model of the trace as it is read. The stacks keep the
+   granules as keys into the table, which holds their time on the stack,
+   so memory follows the footprint rather than the length of the trace. */
+static void profile_trace(inFile, m)
+FILE* inFile;
+Pclone_model m;
+{
+	clone_stack stack[CLONE_STREAMS];
+	clone_pages pages[CLONE_STREAMS];
+	clone_granules granules;
+	unsigned recent[CLONE_STREAMS][CLONE_ANCHORS], last_new[CLONE_STREAMS];
+	int last_stride[CLONE_STREAMS];
+	unsigned access_type, addr, key, word, g;
+	int s, j, a, off, reuse, prev = TRACE_INST_LOAD;
+	long long d, t, skip, stride, best;
+	size_t h;
+	Pclone_stream cs;
+
+	memset(m, 0, sizeof(clone_model));
+	for (s = 0; s < CLONE_STREAMS; s++) {
+		stack_init(&stack[s], CLONE_STACK_START);
+		pages_init(&pages[s]);
+		m->stream[s].lo = 0xFFFFFFFF;
+		last_new[s] = 0;
+		last_stride[s] = 0;
+	}
+	memset(recent, 0, sizeof(recent));
+	// keys are granule * 2 + stream + 1
+	granules_init(&granules);
+
+	while (read_trace_element(inFile, &access_type, &addr)) {
+		if (access_type != TRACE_DATA_LOAD && access_type != TRACE_DATA_STORE &&
+			access_type != TRACE_INST_LOAD) {
+			printf("skipping access, unknown type(%d)\n", access_type);
+			continue;
+		}
+		m->refs++;
+		s = access_type == TRACE_INST_LOAD;
+		cs = &m->stream[s];
+		m->types[prev][access_type]++;
+		prev = access_type;
+		word = addr >> WORD_SIZE_OFFSET;
+		g = word >> CLONE_GRANULE_BITS;
+		off = word & (CLONE_GRANULE - 1);
+
+		key = g * 2 + s + 1;
+		h = granule_slot(&granules, key);
+		reuse = FALSE;
+		if (granules.last[h] >= 0) {
+			d = stack[s].live - stack_count(&stack[s], granules.last[h]);
+			if (d < CLONE_MAX_DEPTH) {
+				cs->depth[depth_bucket((int)d)]++;
+				cs->delta[off - granules.off[h] + CLONE_GRANULE - 1]++;
+				reuse = TRUE;
+			}
+			stack[s].word[granules.last[h]] = CLONE_NO_WORD;
+			stack_add(&stack[s], granules.last[h], -1);
+		}
+		if (!reuse) {
+			cs->cold++;
+			cs->offset[off]++;
+
+			// a scan, or else the nearest of the recent granules is the
+			// anchor, or else a jump
+			best = (long long)g - recent[s][0];
+			for (a = 0, j = 1; j < CLONE_ANCHORS; j++) {
+				stride = (long long)g - recent[s][j];
+				if (llabs(stride) < llabs(best)) {
+					best = stride;
+					a = j;
+				}
+			}
+			if (last_stride[s])
+				cs->scans[last_stride[s] + CLONE_MAX_STRIDE]++;
+			if (last_stride[s] && (long long)g - last_new[s] == last_stride[s])
+				cs->repeats[last_stride[s] + CLONE_MAX_STRIDE]++;
+			else if (best >= -CLONE_MAX_STRIDE && best <= CLONE_MAX_STRIDE) {
+				cs->anchor[a]++;
+				cs->stride[best + CLONE_MAX_STRIDE]++;
+			}
+			else if (pages[s].touched[(g >> CLONE_PAGE_BITS) / 8] & (1 << (g >> CLONE_PAGE_BITS) % 8))
+				cs->far++;
+			else
+				cs->fresh++;
+			last_stride[s] = scan_stride(g, last_new[s]);
+			last_new[s] = g;
+			touch_page(&pages[s], g >> CLONE_PAGE_BITS);
+			if (g < cs->lo)
+				cs->lo = g;
+			if (g > cs->hi)
+				cs->hi = g;
+		}
+
+		memmove(&recent[s][1], &recent[s][0], sizeof(unsigned) * (CLONE_ANCHORS - 1));
+		recent[s][0] = g;
+
+		// the granules the compaction drops are deeper than any reuse,
+		// the others get their new times
+		if (stack[s].now == stack[s].size) {
+			skip = stack[s].live - CLONE_MAX_DEPTH;
+			for (t = 0; t < stack[s].now && skip > 0; t++)
+				if (stack[s].word[t] != CLONE_NO_WORD) {
+					granules.last[granule_slot(&granules, stack[s].word[t])] = -1;
+					skip--;
+				}
+			stack_compact(&stack[s]);
+			for (t = 0; t < stack[s].now; t++)
+				granules.last[granule_slot(&granules, stack[s].word[t])] = t;
+			h = granule_slot(&granules, key);
+		}
+		granules.last[h] = stack[s].now;
+		granules.off[h] = off;
+		stack[s].word[stack[s].now] = key;
+		stack_add(&stack[s], stack[s].now++, 1);
+	}
+
+	for (s = 0; s < CLONE_STREAMS; s++) {
+		stack_free(&stack[s]);
+		pages_free(&pages[s]);
+	}
+	granules_free(&granules);
+}
+/************************************************************/
+
+/************************************************************/
+static void write_counts(out, name, counts, n)
+FILE* out;
+char* name;
+long long* counts;
+int n;
+{
+	int i;
+
+	fprintf(out, "%s", name);
+	for (i = 0; i < n; i++)
+		fprintf(out, " %lld", counts[i]);
+	fprintf(out, "\n");
+}
+
+static void read_counts(in, name, counts, n)
+FILE* in;
+char* name;
+long long* counts;
+int n;
+{
+	char word[32];
+	int i;
+
+	if (fscanf(in, "%31s", word) != 1 || strcmp(word, name)) {
+		printf("error:  clone model lacks %s\n", name);
+		exit(-1);
+	}
+	for (i = 0; i < n; i++)
+		if (fscanf(in, "%lld", &counts[i]) != 1) {
+			printf("error:  clone model has a short %s line\n", name);
+			exit(-1);
+		}
+}
+/************************************************************/
+
+/************************************************************/
+/* profile the trace into a model file, a few kilobytes of text */
+void write_profile(inFile, path)
+FILE* inFile;
+char* path;
+{
+	FILE* out = fopen(path, "w");
+	clone_model m;
+	Pclone_stream cs;
+	int s;
+
+	if (!out) {
+		printf("error:  cannot create clone model %s\n", path);
+		exit(-1);
+	}
+	profile_trace(inFile, &m);
+
+	fprintf(out, "clone %d\n", CLONE_MODEL_VERSION);
+	fprintf(out, "refs %lld\n", m.refs);
+	write_counts(out, "types", &m.types[0][0], 9);
+	for (s = 0; s < CLONE_STREAMS; s++) {
+		cs = &m.stream[s];
+		fprintf(out, "stream %u %u\n", cs->lo, cs->hi);
+		write_counts(out, "depth", cs->depth, CLONE_DEPTH_BUCKETS);
+		write_counts(out, "cold", &cs->cold, 1);
+		write_counts(out, "delta", cs->delta, 2 * CLONE_GRANULE - 1);
+		write_counts(out, "offset", cs->offset, CLONE_GRANULE);
+		write_counts(out, "scans", cs->scans, CLONE_STRIDES);
+		write_counts(out, "repeats", cs->repeats, CLONE_STRIDES);
+		write_counts(out, "anchor", cs->anchor, CLONE_ANCHORS);
+		write_counts(out, "stride", cs->stride, CLONE_STRIDES);
+		write_counts(out, "far", &cs->far, 1);
+		write_counts(out, "fresh", &cs->fresh, 1);
+	}
+	fclose(out);
+
+	printf("\n*** TRACE PROFILE ***\n");
+	printf("  references: \t%lld\n", m.refs);
+	printf("  loads: \t%lld\n", m.types[0][0] + m.types[1][0] + m.types[2][0]);
+	printf("  stores: \t%lld\n", m.types[0][1] + m.types[1][1] + m.types[2][1]);
+	printf("  instructions: %lld\n", m.types[0][2] + m.types[1][2] + m.types[2][2]);
+	printf("  new granules: %lld data, %lld instruction\n", m.stream[0].cold, m.stream[1].cold);
+	printf("  model: \t%s\n", path);
+}
+/************************************************************/
+
+/************************************************************/
+static void read_model(path, m)
+char* path;
+Pclone_model m;
+{
+	FILE* in = fopen(path, "r");
+	Pclone_stream cs;
+	int version, s;
+
+	if (!in) {
+		printf("error:  cannot open clone model %s\n", path);
+		exit(-1);
+	}
+	if (fscanf(in, "clone %d refs %lld", &version, &m->refs) != 2 ||
+		version != CLONE_MODEL_VERSION) {
+		printf("error:  %s is not a clone model\n", path);
+		exit(-1);
+	}
+	read_counts(in, "types", &m->types[0][0], 9);
+	for (s = 0; s < CLONE_STREAMS; s++) {
+		cs = &m->stream[s];
+		if (fscanf(in, " stream %u %u", &cs->lo, &cs->hi) != 2) {
+			printf("error:  clone model lacks stream %d\n", s);
+			exit(-1);
+		}
+		read_counts(in, "depth", cs->depth, CLONE_DEPTH_BUCKETS);
+		read_counts(in, "cold", &cs->cold, 1);
+		read_counts(in, "delta", cs->delta, 2 * CLONE_GRANULE - 1);
+		read_counts(in, "offset", cs->offset, CLONE_GRANULE);
+		read_counts(in, "scans", cs->scans, CLONE_STRIDES);
+		read_counts(in, "repeats", cs->repeats, CLONE_STRIDES);
+		read_counts(in, "anchor", cs->anchor, CLONE_ANCHORS);
+		read_counts(in, "stride", cs->stride, CLONE_STRIDES);
+		read_counts(in, "far", &cs->far, 1);
+		read_counts(in, "fresh", &cs->fresh, 1);
+	}
+	fclose(in);
+}
+/************************************************************/
+
+/************************************************************/
+static unsigned long long rng_state = CLONE_SEED;
+
+/* xorshift64* */
+static unsigned long long next_random()
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* turn counts into running sums, returns the total */
+static long long cumulate(counts, n)
+long long* counts;
+int n;
+{
+	int i;
+
+	for (i = 1; i < n; i++)
+		counts[i] += counts[i - 1];
+	return n ? counts[n - 1] : 0;
+}
+
+/* draw an index of cumulated counts in proportion to the counts */
+static int draw(cum, n)
+long long* cum;
+int n;
+{
+	long long x;
+	int lo = 0, hi = n - 1, mid;
+
+	if (cum[n - 1] <= 0)
+		return -1;
+	x = (long long)(next_random() % (unsigned long long)cum[n - 1]);
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (cum[mid] > x)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+/************************************************************/
+
+
+
+/************************************************************/
+/* the granule after the new granules before it, one that does not
+   continue a scan strides from an anchor, or lands on a page */
+static unsigned new_granule(cs, kind, recent, pages, last_new, last_stride)
+Pclone_stream cs;
+long long* kind;
+unsigned* recent;
+Pclone_pages pages;
+unsigned last_new;
+int last_stride;
+{
+	long long* scan = &cs->scans[last_stride + CLONE_MAX_STRIDE];
+	unsigned span, page;
+	int k;
+
+	if (last_stride && *scan > 0 &&
+		next_random() % (unsigned long long)*scan <
+		(unsigned long long)cs->repeats[last_stride + CLONE_MAX_STRIDE])
+		return last_new + last_stride;
+
+	k = draw(kind, 3);
+	if (k == 0)
+		return recent[draw(cs->anchor, CLONE_ANCHORS)] +
+			draw(cs->stride, CLONE_STRIDES) - CLONE_MAX_STRIDE;
+	if (k == 1 && pages->n)
+		page = pages->list[next_random() % pages->n];
+	else {
+		span = ((cs->hi - cs->lo) >> CLONE_PAGE_BITS) + 1;
+		page = (cs->lo >> CLONE_PAGE_BITS) + (unsigned)(next_random() % span);
+	}
+	return (page << CLONE_PAGE_BITS) + (unsigned)(next_random() % (1 << CLONE_PAGE_BITS));
+}
+/************************************************************/
+
+/************************************************************/
+/* write n_refs references drawn from the model to a binary trace */
+void write_clone(model_path, n_refs, path)
+char* model_path;
+long long n_refs;
+char* path;
+{
+	clone_stack stack[CLONE_STREAMS];
+	clone_pages pages[CLONE_STREAMS];
+	unsigned recent[CLONE_STREAMS][CLONE_ANCHORS], last_new[CLONE_STREAMS];
+	int last_stride[CLONE_STREAMS];
+	long long kind[CLONE_STREAMS][3], i, x;
+	unsigned char header[BINARY_TRACE_HEADER], buf[4 * 4096];
+	unsigned word, g, record;
+	int s, k, d, type = TRACE_INST_LOAD, n = 0;
+	long long t;
+	Pclone_stream cs;
+	clone_model m;
+	FILE* out;
+
+	read_model(model_path, &m);
+	if (n_refs < 0)
+		n_refs = m.refs;
+	for (k = 0; k < 3; k++)
+		cumulate(m.types[k], 3);
+	for (s = 0; s < CLONE_STREAMS; s++) {
+		cs = &m.stream[s];
+		// the new granule event goes last among the depth buckets
+		cs->cold += cumulate(cs->depth, CLONE_DEPTH_BUCKETS);
+		cumulate(cs->delta, 2 * CLONE_GRANULE - 1);
+		cumulate(cs->offset, CLONE_GRANULE);
+		cumulate(cs->anchor, CLONE_ANCHORS);
+		kind[s][0] = cumulate(cs->stride, CLONE_STRIDES);
+		kind[s][1] = kind[s][0] + cs->far;
+		kind[s][2] = kind[s][1] + cs->fresh;
+		stack_init(&stack[s], CLONE_STACK_START);
+		pages_init(&pages[s]);
+		for (k = 0; k < CLONE_ANCHORS; k++)
+			recent[s][k] = cs->lo;
+		last_new[s] = cs->lo;
+		last_stride[s] = 0;
+	}
+
+	out = fopen(path, "wb");
+	if (!out) {
+		printf("error:  cannot create clone trace %s\n", path);
+		exit(-1);
+	}
+	memset(header, 0, sizeof(header));
+	memcpy(header, BINARY_TRACE_MAGIC, 4);
+	header[4] = BINARY_TRACE_VERSION;
+	fwrite(header, 1, sizeof(header), out);
+
+	for (i = 0; i < n_refs; i++) {
+		k = draw(m.types[type], 3);
+		type = k < 0 ? TRACE_DATA_LOAD : k;
+		s = type == TRACE_INST_LOAD;
+		cs = &m.stream[s];
+
+		// a reuse at a depth the stack holds, or else a new granule
+		d = -1;
+		if (cs->cold > 0 && stack[s].live) {
+			x = (long long)(next_random() % (unsigned long long)cs->cold);
+			if (x < cs->depth[CLONE_DEPTH_BUCKETS - 1]) {
+				k = draw(cs->depth, CLONE_DEPTH_BUCKETS);
+				d = bucket_low(k) + (int)(next_random() % bucket_width(k));
+				// early on the stack may be shallower than the draw
+				if (d >= stack[s].live)
+					d = stack[s].live - 1;
+			}
+		}
+		if (d >= 0) {
+			t = stack_find(&stack[s], d);
+			word = stack[s].word[t];
+			stack[s].word[t] = CLONE_NO_WORD;
+			stack_add(&stack[s], t, -1);
+			g = word >> CLONE_GRANULE_BITS;
+			word += draw(cs->delta, 2 * CLONE_GRANULE - 1) - (CLONE_GRANULE - 1);
+			word = (g << CLONE_GRANULE_BITS) | (word & (CLONE_GRANULE - 1));
+		}
+		else {
+			g = new_granule(cs, kind[s], recent[s], &pages[s], last_new[s], last_stride[s]);
+			g &= CLONE_WORD_MASK >> CLONE_GRANULE_BITS;
+			last_stride[s] = scan_stride(g, last_new[s]);
+			last_new[s] = g;
+			touch_page(&pages[s], g >> CLONE_PAGE_BITS);
+			k = draw(cs->offset, CLONE_GRANULE);
+			word = (g << CLONE_GRANULE_BITS) | (k < 0 ? 0 : k);
+		}
+		memmove(&recent[s][1], &recent[s][0], sizeof(unsigned) * (CLONE_ANCHORS - 1));
+		recent[s][0] = g;
+
+		if (stack[s].now == stack[s].size)
+			stack_compact(&stack[s]);
+		stack[s].word[stack[s].now] = word;
+		stack_add(&stack[s], stack[s].now++, 1);
+
+		record = (word << WORD_SIZE_OFFSET) | type;
+		buf[n++] = record;
+		buf[n++] = record >> 8;
+		buf[n++] = record >> 16;
+		buf[n++] = record >> 24;
+		if (n == sizeof(buf)) {
+			fwrite(buf, 1, n, out);
+			n = 0;
+		}
+	}
+	fwrite(buf, 1, n, out);
+	fclose(out);
+
+	for (s = 0; s < CLONE_STREAMS; s++) {
+		stack_free(&stack[s]);
+		pages_free(&pages[s]);
+	}
+	printf("\n*** CLONE ***\n");
+	printf("  references: \t%lld written to %s\n", n_refs, path);
+}
+/************************************************************/
@@ -0,0 +1,79 @@
+/*
+ * clone.h
+ */
+
+
+/* a trace is modelled as two streams, data (loads and stores) and
+   instructions, of references to granules of a few words. Each reference
+   either reuses the granule at some LRU stack depth of its stream, moving
+   from the word it last touched there by some delta, or touches a new
+   granule. A new granule lies at the stride that led to the previous new
+   one, to keep scans, at some stride from one of the last few granules of
+   the stream, or on a page touched before, or on a page of its own. */
+#define CLONE_STREAMS 2
+#define CLONE_GRANULE_BITS 4		/* log2 of the words of a granule, 64 bytes */
+#define CLONE_GRANULE (1 << CLONE_GRANULE_BITS)
+#define CLONE_MAX_DEPTH (1 << 20)	/* deeper reuse counts as a new granule */
+#define CLONE_STACK_START 4096	/* times of a stack before it first grows */
+#define CLONE_GRANULES_START 4096	/* slots of the granule table before it first grows */
+#define CLONE_DEPTH_BUCKETS 80		/* 4 per power of two up to CLONE_MAX_DEPTH */
+#define CLONE_MAX_STRIDE 256		/* in granules, longer strides are jumps */
+#define CLONE_STRIDES (2 * CLONE_MAX_STRIDE + 1)
+#define CLONE_ANCHORS 8			/* recent granules a new one may be near */
+#define CLONE_PAGE_BITS 6		/* log2 of the granules of a page, 4 KB */
+#define CLONE_WORD_MASK (0xFFFFFFFF >> WORD_SIZE_OFFSET)
+#define CLONE_PAGES ((CLONE_WORD_MASK >> (CLONE_GRANULE_BITS + CLONE_PAGE_BITS)) + 1)
+#define CLONE_NO_WORD 0xFFFFFFFF	/* a time whose granule moved up the stack */
+#define CLONE_SEED 0x9E3779B97F4A7C15ULL
+#define CLONE_MODEL_VERSION 1
+
+/* structure definitions */
+typedef struct clone_stream_ {
+  long long depth[CLONE_DEPTH_BUCKETS];	/* reuses by stack depth bucket */
+  long long cold;			/* references to a new granule */
+  long long delta[2 * CLONE_GRANULE - 1];	/* word moves within a reused granule */
+  long long offset[CLONE_GRANULE];	/* first word touched in a new granule */
+  long long scans[CLONE_STRIDES];	/* new granules after a new one at each stride */
+  long long repeats[CLONE_STRIDES];	/* of which repeat that stride */
+  long long anchor[CLONE_ANCHORS];	/* the others by how recent their anchor is */
+  long long stride[CLONE_STRIDES];	/* new granule minus its anchor */
+  long long far;			/* further away, on a page touched before */
+  long long fresh;			/* on a page of their own */
+  unsigned lo, hi;			/* granule footprint */
+} clone_stream, *Pclone_stream;
+
+typedef struct clone_model_ {
+  long long refs;
+  long long types[3][3];	/* type of a reference after each type */
+  clone_stream stream[CLONE_STREAMS];
+} clone_model, *Pclone_model;
+
+/* LRU stack of the granules a stream has touched, by time of last use */
+typedef struct clone_stack_ {
+  unsigned* word;		/* word last touched at each time */
+  int* tree;			/* Fenwick tree of the times still current */
+  long long size;		/* times before the stack is compacted */
+  long long now;
+  long long live;		/* granules on the stack */
+} clone_stack, *Pclone_stack;
+
+/* open addressed table of the granules the streams have touched */
+typedef struct clone_granules_ {
+  unsigned* key;		/* granule * 2 + stream + 1, 0 if free */
+  long long* last;		/* time on its stack, -1 if not on it */
+  unsigned char* off;		/* word it last touched */
+  size_t size;
+  size_t n;
+} clone_granules, *Pclone_granules;
+
+/* the pages a stream has touched */
+typedef struct clone_pages_ {
+  unsigned char* touched;	/* bit per page */
+  unsigned* list;
+  int n;
+} clone_pages, *Pclone_pages;
+
+
+/* function prototypes */
+void write_profile();
+void write_clone();
@@ -0,0 +1,224 @@
+/*
+ * corpus.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <glob.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "cache.h"
+#include "main.h"
+#include "trace.h"
+#include "corpus.h"
+
+#ifndef _WIN32
+static Pcorpus_trace corpus;
+static int corpus_size;
+static cache_params corpus_params;	/* the configuration of the command line */
+
+static Pcorpus_deque deques;
+static int n_workers;
+static pthread_mutex_t deque_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/************************************************************/
+/* the next trace for worker w: its own largest, else another worker's
+   smallest. Returns -1 when every trace has been taken. */
+static int next_trace(w)
+int w;
+{
+	Pcorpus_deque d = &deques[w];
+	int i, k = -1;
+
+	pthread_mutex_lock(&deque_lock);
+	if (d->head < d->tail)
+		k = d->items[d->head++];
+	else
+		for (i = 1; i < n_workers && k < 0; i++) {
+			Pcorpus_deque v = &deques[(w + i) % n_workers];
+			if (v->head < v->tail)
+				k = v->items[--v->tail];
+		}
+	pthread_mutex_unlock(&deque_lock);
+	return k;
+}
+/************************************************************/
+
+/************************************************************/
+static void* corpus_worker(arg)
+void* arg;
+{
+	int w = (int)(long)arg;
+	Pcorpus_trace t;
+	Pparsed_ref refs;
+	long long i;
+	int k;
+
+	load_cache_params(&corpus_params);
+	while ((k = next_trace(w)) >= 0) {
+		t = &corpus[k];
+		t->n_refs = load_trace_file(t->name, &refs);
+		if (t->n_refs < 0)
+			continue;
+
+		init_cache();
+		for (i = 0; i < t->n_refs; i++)
+			if (refs[i].access_type <= TRACE_INST_LOAD) {
+				set_cache_class(refs[i].cls >= 0 ? refs[i].cls : 0);
+				perform_access(refs[i].addr, refs[i].access_type);
+			}
+		flush();
+		get_cache_stats(&t->inst, &t->data);
+		release_cache();
+		free(refs);
+	}
+	return NULL;
+}
+/************************************************************/
+
+/************************************************************/
+static int larger_trace(a, b)
+const void* a;
+const void* b;
+{
+	long long d = ((Pcorpus_trace)b)->size - ((Pcorpus_trace)a)->size;
+
+	return d > 0 ? 1 : d < 0 ? -1 : strcmp(((Pcorpus_trace)a)->name, ((Pcorpus_trace)b)->name);
+}
+
+static int trace_name_order(a, b)
+const void* a;
+const void* b;
+{
+	return strcmp(((Pcorpus_trace)a)->name, ((Pcorpus_trace)b)->name);
+}
+/************************************************************/
+
+/************************************************************/
+static void print_rate(misses, accesses)
+long long misses, accesses;
+{
+	if (!accesses)
+		printf("  miss rate: 0 (0)\n");
+	else
+		printf("  miss rate: %2.4f (hit rate %2.4f)\n", (double)misses / (double)accesses,
+			   1.0 - (double)misses / (double)accesses);
+}
+/************************************************************/
+#endif
+
+/************************************************************/
+/* simulate the configuration of the command line on every trace that
+   pattern, a directory or a glob, names, with workers threads */
+void run_corpus(pattern, workers)
+char* pattern;
+int workers;
+{
+#ifdef _WIN32
+	printf("error:  corpus mode needs glob and threads\n");
+	exit(-1);
+#else
+	long long inst_acc = 0, inst_miss = 0, data_acc = 0, data_miss = 0;
+	long long inst_repl = 0, data_repl = 0, fetched = 0, copied = 0;
+	char* dir_pattern = NULL;
+	pthread_t* threads;
+	struct stat st;
+	glob_t g;
+	int i, n_read = 0;
+
+	// a directory stands for every file in it
+	if (!stat(pattern, &st) && S_ISDIR(st.st_mode)) {
+		dir_pattern = (char*)malloc(strlen(pattern) + 3);
+		sprintf(dir_pattern, "%s/*", pattern);
+		pattern = dir_pattern;
+	}
+	if (glob(pattern, 0, NULL, &g) || !g.gl_pathc) {
+		printf("error:  no trace files match %s\n", pattern);
+		exit(-1);
+	}
+
+	corpus = (Pcorpus_trace)calloc(g.gl_pathc, sizeof(corpus_trace));
+	for (i = 0; i < (int)g.gl_pathc; i++) {
+		if (stat(g.gl_pathv[i], &st) || !S_ISREG(st.st_mode))
+			continue;
+		corpus[corpus_size].name = strdup(g.gl_pathv[i]);
+		corpus[corpus_size].size = st.st_size;
+		corpus_size++;
+	}
+	globfree(&g);
+	free(dir_pattern);
+
+	// deal the traces out largest first, round robin
+	qsort(corpus, corpus_size, sizeof(corpus_trace), larger_trace);
+	if (workers < 1)
+		workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	n_workers = workers < corpus_size ? workers : corpus_size;
+	if (n_workers < 1)
+		n_workers = 1;
+	deques = (Pcorpus_deque)calloc(n_workers, sizeof(corpus_deque));
+	for (i = 0; i < n_workers; i++)
+		deques[i].items = (int*)malloc(sizeof(int) * (corpus_size / n_workers + 1));
+	for (i = 0; i < corpus_size; i++) {
+		Pcorpus_deque d = &deques[i % n_workers];
+		d->items[d->tail++] = i;
+	}
+
+	save_cache_params(&corpus_params);
+	init_hex_value();
+	threads = (pthread_t*)malloc(sizeof(pthread_t) * n_workers);
+	for (i = 0; i < n_workers; i++)
+		pthread_create(&threads[i], NULL, corpus_worker, (void*)(long)i);
+	for (i = 0; i < n_workers; i++)
+		pthread_join(threads[i], NULL);
+	for (i = 0; i < n_workers; i++)
+		free(deques[i].items);
+	free(deques);
+	free(threads);
+
+	qsort(corpus, corpus_size, sizeof(corpus_trace), trace_name_order);
+	printf("\n*** CORPUS STATISTICS ***\n");
+	printf("  %-40s %10s %8s %10s %8s\n", "trace", "I access", "I miss", "D access", "D miss");
+	for (i = 0; i < corpus_size; i++) {
+		Pcorpus_trace t = &corpus[i];
+
+		if (t->n_refs < 0) {
+			printf("  %-40s cannot be read\n", t->name);
+			continue;
+		}
+		printf("  %-40s %10lld %8lld %10lld %8lld\n", t->name,
+			   t->inst.accesses, t->inst.misses, t->data.accesses, t->data.misses);
+		n_read++;
+		inst_acc += t->inst.accesses;
+		inst_miss += t->inst.misses;
+		inst_repl += t->inst.replacements;
+		data_acc += t->data.accesses;
+		data_miss += t->data.misses;
+		data_repl += t->data.replacements;
+		fetched += t->inst.demand_fetches + t->data.demand_fetches;
+		copied += t->inst.copies_back + t->data.copies_back;
+	}
+
+	// totals over the corpus, so the miss rates weigh traces by accesses
+	printf("\n*** AGGREGATE (%d traces, %d workers) ***\n", n_read, n_workers);
+	printf(" INSTRUCTIONS\n");
+	printf("  accesses:  %lld\n", inst_acc);
+	printf("  misses:    %lld\n", inst_miss);
+	print_rate(inst_miss, inst_acc);
+	printf("  replace:   %lld\n", inst_repl);
+	printf(" DATA\n");
+	printf("  accesses:  %lld\n", data_acc);
+	printf("  misses:    %lld\n", data_miss);
+	print_rate(data_miss, data_acc);
+	printf("  replace:   %lld\n", data_repl);
+	printf(" TRAFFIC (in words)\n");
+	printf("  demand fetch:  %lld\n", fetched);
+	printf("  copies back:   %lld\n", copied);
+#endif
+}
+/************************************************************/
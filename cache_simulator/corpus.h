@@ -0,0 +1,25 @@
+/*
+ * corpus.h
+ */
+
+
+/* structure definitions */
+typedef struct corpus_trace_ {
+  char* name;
+  long long size;		/* bytes, the estimate of its work */
+  long long n_refs;		/* -1 if it could not be read */
+  cache_stat inst;
+  cache_stat data;
+} corpus_trace, *Pcorpus_trace;
+
+/* traces a worker runs, the largest at the head. Its owner takes from
+   the head, idle workers steal from the tail. */
+typedef struct corpus_deque_ {
+  int* items;			/* indices into the corpus */
+  int head;
+  int tail;
+} corpus_deque, *Pcorpus_deque;
+
+
+/* function prototypes */
+void run_corpus();
@@ -0,0 +1,378 @@
+/*
+ * delta.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "cache.h"
+#include "main.h"
+#include "opt.h"
+#include "delta.h"
+
+static cache_params params_b;		/* configuration B, the command line with the delta flags */
+static char* delta_flags;
+
+#ifndef _WIN32
+/* the round both configurations run, B on a thread of its own since the
+   cache model keeps its state per thread */
+static trace_ref chunk[DELTA_CHUNK];
+static int chunk_n;
+static unsigned char missed_a[DELTA_CHUNK];
+static unsigned char missed_b[DELTA_CHUNK];
+static int round_posted, round_done, stopping;
+static pthread_mutex_t delta_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t delta_go = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t delta_done = PTHREAD_COND_INITIALIZER;
+
+static delta_table blocks;
+static delta_table regions;
+#endif
+
+
+/************************************************************/
+/* build configuration B from the configuration of the command line and
+   the flags of -delta, the same cache flags sim takes */
+void check_delta_flags(flags)
+char* flags;
+{
+	char* copy = strdup(flags);
+	char* tok[DELTA_MAX_FLAGS];
+	cache_params params_a;
+	int n = 0, i;
+
+	for (tok[n] = strtok(copy, " \t"); tok[n] && n < DELTA_MAX_FLAGS - 1; )
+		tok[++n] = strtok(NULL, " \t");
+	if (!n) {
+		printf("error:  -delta needs the flags of the second configuration\n");
+		exit(-1);
+	}
+
+	save_cache_params(&params_a);
+	for (i = 0; i < n; i++) {
+		if (!strcmp(tok[i], "-wb"))
+			set_cache_param(CACHE_PARAM_WRITEBACK, TRUE);
+		else if (!strcmp(tok[i], "-wt"))
+			set_cache_param(CACHE_PARAM_WRITETHROUGH, TRUE);
+		else if (!strcmp(tok[i], "-wa"))
+			set_cache_param(CACHE_PARAM_WRITEALLOC, TRUE);
+		else if (!strcmp(tok[i], "-nw"))
+			set_cache_param(CACHE_PARAM_NOWRITEALLOC, TRUE);
+		else if (!strcmp(tok[i], "-wbraw"))
+			set_cache_param(CACHE_PARAM_WBUF_BYPASS, TRUE);
+		else if (strcmp(tok[i], "-bs") && strcmp(tok[i], "-us") && strcmp(tok[i], "-is") &&
+				 strcmp(tok[i], "-ds") && strcmp(tok[i], "-a") && strcmp(tok[i], "-ss") &&
+				 strcmp(tok[i], "-mshr") && strcmp(tok[i], "-lat") && strcmp(tok[i], "-wbuf") &&
+				 strcmp(tok[i], "-wbd")) {
+			printf("error:  -delta does not take %s\n", tok[i]);
+			exit(-1);
+		}
+		else if (i + 1 == n) {
+			printf("error:  -delta flag %s without a value\n", tok[i]);
+			exit(-1);
+		}
+		else if (!strcmp(tok[i], "-bs"))
+			set_cache_param(CACHE_PARAM_BLOCK_SIZE, atoi(tok[++i]));
+		else if (!strcmp(tok[i], "-us"))
+			set_cache_param(CACHE_PARAM_USIZE, size_arg(tok[++i]));
+		else if (!strcmp(tok[i], "-is"))
+			set_cache_param(CACHE_PARAM_ISIZE, size_arg(tok[++i]));
+		else if (!strcmp(tok[i], "-ds"))
+			set_cache_param(CACHE_PARAM_DSIZE, size_arg(tok[++i]));
+		else if (!strcmp(tok[i], "-a"))
+			set_cache_param(CACHE_PARAM_ASSOC, atoi(tok[++i]));
+		else if (!strcmp(tok[i], "-ss"))
+			set_cache_param(CACHE_PARAM_SECTOR_SIZE, atoi(tok[++i]));
+		else if (!strcmp(tok[i], "-mshr"))
+			set_cache_param(CACHE_PARAM_MSHRS, atoi(tok[++i]));
+		else if (!strcmp(tok[i], "-lat"))
+			set_cache_param(CACHE_PARAM_FILL_LATENCY, atoi(tok[++i]));
+		else if (!strcmp(tok[i], "-wbuf"))
+			set_cache_param(CACHE_PARAM_WBUF_ENTRIES, atoi(tok[++i]));
+		else
+			set_cache_param(CACHE_PARAM_WBUF_DRAIN, atoi(tok[++i]));
+	}
+	save_cache_params(&params_b);
+	load_cache_params(&params_a);
+	delta_flags = flags;
+	free(copy);
+}
+/************************************************************/
+
+#ifndef _WIN32
+/************************************************************/
+static int slot_of(t, key)
+Pdelta_table t;
+unsigned key;
+{
+	int h = (key * 2654435761u) >> 21;
+
+	while (t->slot[h] && t->heap[t->slot[h] - 1].key != key)
+		h = (h + 1) & (2 * DELTA_COUNTERS - 1);
+	return h;
+}
+
+/* take key out of the index, moving up the keys probed past it */
+static void slot_remove(t, key)
+Pdelta_table t;
+unsigned key;
+{
+	int h = slot_of(t, key), j = h, home;
+
+	t->slot[h] = 0;
+	for (;;) {
+		j = (j + 1) & (2 * DELTA_COUNTERS - 1);
+		if (!t->slot[j])
+			return;
+		home = (t->heap[t->slot[j] - 1].key * 2654435761u) >> 21;
+		// the key at j stays unless its probe passed through h
+		if (h <= j ? (home > h && home <= j) : (home > h || home <= j))
+			continue;
+		t->slot[h] = t->slot[j];
+		t->slot[j] = 0;
+		h = j;
+	}
+}
+
+static void heap_swap(t, i, j)
+Pdelta_table t;
+int i, j;
+{
+	int hi = slot_of(t, t->heap[i].key), hj = slot_of(t, t->heap[j].key);
+	delta_counter c = t->heap[i];
+
+	t->heap[i] = t->heap[j];
+	t->heap[j] = c;
+	t->slot[hi] = j + 1;
+	t->slot[hj] = i + 1;
+}
+
+static void sift_down(t, i)
+Pdelta_table t;
+int i;
+{
+	int c;
+
+	while ((c = 2 * i + 1) < t->n) {
+		if (c + 1 < t->n && t->heap[c + 1].count < t->heap[c].count)
+			c++;
+		if (t->heap[i].count <= t->heap[c].count)
+			return;
+		heap_swap(t, i, c);
+		i = c;
+	}
+}
+
+static void sift_up(t, i)
+Pdelta_table t;
+int i;
+{
+	while (i && t->heap[(i - 1) / 2].count > t->heap[i].count) {
+		heap_swap(t, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+/* count a diverging reference of key, a full table hands the least
+   counted key's place and count to it */
+static void table_add(t, key, a_missed)
+Pdelta_table t;
+unsigned key;
+int a_missed;
+{
+	int h = slot_of(t, key), i;
+	Pdelta_counter c;
+
+	if (t->slot[h]) {
+		i = t->slot[h] - 1;
+		c = &t->heap[i];
+		c->count++;
+	}
+	else {
+		if (t->n < DELTA_COUNTERS) {
+			i = t->n++;
+			c = &t->heap[i];
+			c->count = 1;
+			c->error = 0;
+		}
+		else {
+			i = 0;
+			c = &t->heap[0];
+			slot_remove(t, c->key);
+			h = slot_of(t, key);
+			c->error = c->count;
+			c->count++;
+		}
+		c->key = key;
+		c->a_only = 0;
+		c->b_only = 0;
+		t->slot[h] = i + 1;
+		sift_up(t, i);
+		i = t->slot[slot_of(t, key)] - 1;
+		c = &t->heap[i];
+	}
+	if (a_missed)
+		c->a_only++;
+	else
+		c->b_only++;
+	sift_down(t, i);
+}
+/************************************************************/
+
+/************************************************************/
+static int larger_count(a, b)
+const void* a;
+const void* b;
+{
+	Pdelta_counter x = (Pdelta_counter)a, y = (Pdelta_counter)b;
+
+	if (x->count != y->count)
+		return x->count < y->count ? 1 : -1;
+	return x->key < y->key ? -1 : x->key > y->key;
+}
+
+static void print_table(t, title, unit, top)
+Pdelta_table t;
+char* title;
+unsigned unit;
+int top;
+{
+	Pdelta_counter sorted = (Pdelta_counter)malloc(sizeof(delta_counter) * (t->n ? t->n : 1));
+	int i;
+
+	memcpy(sorted, t->heap, sizeof(delta_counter) * t->n);
+	qsort(sorted, t->n, sizeof(delta_counter), larger_count);
+	printf(" TOP %s (%u bytes)\n", title, unit);
+	printf("  %-12s %10s %8s %10s %10s\n", "address", "diverged", "error", "A only", "B only");
+	for (i = 0; i < t->n && i < top; i++)
+		printf("  0x%08x   %10lld %8lld %10lld %10lld\n", sorted[i].key * unit, sorted[i].count,
+			   sorted[i].error, sorted[i].a_only, sorted[i].b_only);
+	free(sorted);
+}
+/************************************************************/
+
+/************************************************************/
+/* run the chunk on this thread's cache, noting which references miss */
+static void run_chunk(missed)
+unsigned char* missed;
+{
+	long long before;
+	int i;
+
+	for (i = 0; i < chunk_n; i++) {
+		before = get_cache_misses();
+		perform_access(chunk[i].addr, chunk[i].access_type);
+		missed[i] = get_cache_misses() != before;
+	}
+}
+
+static void* delta_worker(arg)
+void* arg;
+{
+	int r;
+
+	(void)arg;
+	load_cache_params(&params_b);
+	init_cache();
+	for (r = 1;; r++) {
+		pthread_mutex_lock(&delta_lock);
+		while (round_posted < r && !stopping)
+			pthread_cond_wait(&delta_go, &delta_lock);
+		pthread_mutex_unlock(&delta_lock);
+		if (round_posted < r)
+			break;
+
+		run_chunk(missed_b);
+		pthread_mutex_lock(&delta_lock);
+		round_done = r;
+		pthread_cond_signal(&delta_done);
+		pthread_mutex_unlock(&delta_lock);
+	}
+
+	flush();
+	printf("\n*** DELTA CONFIGURATION (%s) ***\n", delta_flags);
+	dump_settings();
+	print_stats();
+	release_cache();
+	return NULL;
+}
+/************************************************************/
+#endif
+
+/************************************************************/
+/* run the trace through the configuration of the command line, A, and
+   configuration B in lock-step, and report where their outcomes differ */
+void run_delta(inFile, top, region)
+FILE* inFile;
+int top, region;
+{
+#ifdef _WIN32
+	printf("error:  delta mode needs threads\n");
+	exit(-1);
+#else
+	long long refs = 0, diverged = 0, a_only = 0;
+	unsigned access_type, addr, block;
+	cache_params params_a;
+	pthread_t worker;
+	int i;
+
+	// blocks at the finer of the two block sizes
+	save_cache_params(&params_a);
+	block = params_a.block_size < params_b.block_size ? params_a.block_size : params_b.block_size;
+	pthread_create(&worker, NULL, delta_worker, NULL);
+
+	for (;;) {
+		for (chunk_n = 0; chunk_n < DELTA_CHUNK && read_trace_element(inFile, &access_type, &addr); ) {
+			if (access_type > TRACE_INST_LOAD) {
+				printf("skipping access, unknown type(%d)\n", access_type);
+				continue;
+			}
+			chunk[chunk_n].addr = addr;
+			chunk[chunk_n++].access_type = access_type;
+		}
+		if (!chunk_n)
+			break;
+
+		pthread_mutex_lock(&delta_lock);
+		round_posted++;
+		pthread_cond_signal(&delta_go);
+		pthread_mutex_unlock(&delta_lock);
+		run_chunk(missed_a);
+		pthread_mutex_lock(&delta_lock);
+		while (round_done < round_posted)
+			pthread_cond_wait(&delta_done, &delta_lock);
+		pthread_mutex_unlock(&delta_lock);
+
+		for (i = 0; i < chunk_n; i++)
+			if (missed_a[i] != missed_b[i]) {
+				diverged++;
+				a_only += missed_a[i];
+				table_add(&blocks, chunk[i].addr / block, missed_a[i]);
+				table_add(&regions, chunk[i].addr / region, missed_a[i]);
+			}
+		refs += chunk_n;
+	}
+
+	flush();
+	print_stats();
+
+	pthread_mutex_lock(&delta_lock);
+	stopping = TRUE;
+	pthread_cond_signal(&delta_go);
+	pthread_mutex_unlock(&delta_lock);
+	pthread_join(worker, NULL);
+
+	printf("\n*** DELTA ***\n");
+	printf("  references: \t%lld\n", refs);
+	printf("  diverged: \t%lld (%2.4f)\n", diverged, refs ? (double)diverged / refs : 0.0);
+	printf("  A missed, B hit: \t%lld\n", a_only);
+	printf("  B missed, A hit: \t%lld\n", diverged - a_only);
+	print_table(&blocks, "BLOCKS", block, top);
+	print_table(&regions, "REGIONS", (unsigned)region, top);
+#endif
+}
+/************************************************************/
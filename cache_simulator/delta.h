@@ -0,0 +1,36 @@
+/*
+ * delta.h
+ */
+
+
+#define DELTA_CHUNK 65536		/* references both configurations run per round */
+#define DELTA_COUNTERS 1024		/* keys each top-N table tracks */
+#define DELTA_DEFAULT_TOP 20
+#define DELTA_DEFAULT_REGION 4096
+#define DELTA_MAX_FLAGS 32
+
+/* structure definitions */
+
+/* a key of a space-saving table. count over-estimates the diverging
+   references of the key by at most error, a_only and b_only count those
+   seen since the key entered the table. */
+typedef struct delta_counter_ {
+  unsigned key;
+  long long count;
+  long long error;
+  long long a_only;		/* misses of configuration A that B hit */
+  long long b_only;
+} delta_counter, *Pdelta_counter;
+
+/* the heaviest keys of a stream in fixed memory, a min-heap on count
+   with a linear probing index of key to heap position */
+typedef struct delta_table_ {
+  delta_counter heap[DELTA_COUNTERS];
+  int n;
+  int slot[2 * DELTA_COUNTERS];	/* heap position + 1, 0 if empty */
+} delta_table, *Pdelta_table;
+
+
+/* function prototypes */
+void check_delta_flags();
+void run_delta();
@@ -6,20 +6,165 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 #include "cache.h"
 #include "main.h"
+#include "tlb.h"
+#include "opt.h"
+#include "trace.h"
+#include "server.h"
+#include "sweep.h"
+#include "corpus.h"
+#include "phase.h"
+#include "clone.h"
+#include "delta.h"
+#include "prof.h"
 
 static FILE* traceFile;
 
+/* co-running traces replayed into one shared cache */
+static char** traceNames;
+static FILE** traceFiles;
+static int n_traces;
+static int sched_quantum = 1;		/* references per scheduling turn */
+static int* sched_weights;		/* turns per round of each trace */
+static char* sched_weight_list;
+static int translating;
+
+/* classes of service, per trace file or per reference */
+static int* traceClasses;		/* class of each trace file */
+static char* trace_class_list;
+static int classifying;			/* way partitions are configured */
+static int occ_interval;		/* references between occupancy samples */
+static int trace_element_class;		/* class field of the last reference, or -1 */
+static int current_trace;
+
+/* progress of the replay */
+static long long trace_bytes;		/* size of the trace files, -1 if one is a pipe */
+static double progress_start;		/* seconds */
+static double progress_last;
+
+static int opt_mode;			/* also simulate Belady OPT replacement */
+static int* traceBinary;		/* trace file i is in the binary format */
+static Ptext_trace* traceText;		/* mapped ASCII trace file i, or NULL */
+static int parse_threads = -1;		/* -1 = one per processor */
+static char* miss_trace_name;		/* write the miss stream here */
+static char* server_path;		/* answer requests on this socket */
+static int server_workers = -1;		/* -1 = one per processor */
+static char* sweep_path;		/* run the points of this sweep */
+static char* store_path;		/* results of earlier sweeps */
+static char* export_path;		/* table of the sweep results */
+static sweep_spec sweep;
+static char* corpus_pattern;		/* simulate each trace this names */
+static int phase_length;		/* sample phases of this many references */
+static int phase_clusters = PHASE_DEFAULT_CLUSTERS;
+static int phase_warmup = -1;		/* -1 = one interval */
+static char* profile_path;		/* write the model of the trace here */
+static char* clone_path;		/* generate a trace from this model */
+static long long clone_refs = -1;	/* -1 = as many as the profiled trace */
+static char* delta_flags;		/* flags of the configuration to compare with */
+static int report_top = DELTA_DEFAULT_TOP;	/* rows of the delta and hotspot reports */
+static int region_size = DELTA_DEFAULT_REGION;
+static char* hotspot_path;		/* dump per-set and per-region counters here */
+static char* prof_path;			/* time the simulator's stages, stacks go here */
+
+/* pre-filter of repeated references, the block key of the previous
+   reference of each access type */
+static unsigned last_block[TRACE_INST_LOAD + 1];
+static int last_valid[TRACE_INST_LOAD + 1];
+
 
 int main(argc, argv)
 int argc;
 char** argv;
 {
+	int i;
+
 	parse_args(argc, argv);
+	if (clone_path) {
+		write_clone(clone_path, clone_refs, traceNames[0]);
+		return 0;
+	}
+	if (corpus_pattern) {
+		run_corpus(corpus_pattern, server_workers);
+		return 0;
+	}
 	init_cache();
-	play_trace(traceFile);
+	init_tlb();
+	if (server_path || sweep_path) {
+		Ptrace_ref* refs = (Ptrace_ref*)malloc(sizeof(Ptrace_ref) * n_traces);
+		long long* n_refs = (long long*)malloc(sizeof(long long) * n_traces);
+
+		for (i = 0; i < n_traces; i++) {
+			current_trace = i;
+			n_refs[i] = load_trace(traceFiles[i], &refs[i]);
+			if (traceText[i])
+				close_text_trace(traceText[i]);
+		}
+		if (server_path)
+			run_server(server_path, server_workers, refs, n_refs, traceNames, n_traces);
+		else
+			run_sweep(&sweep, store_path, export_path, server_workers, refs, n_refs, traceNames, n_traces);
+		return 0;
+	}
+	if (profile_path) {
+		write_profile(traceFile, profile_path);
+		if (traceText[0])
+			close_text_trace(traceText[0]);
+		return 0;
+	}
+	if (delta_flags) {
+		run_delta(traceFile, report_top, region_size);
+		if (traceText[0])
+			close_text_trace(traceText[0]);
+		return 0;
+	}
+	if (phase_length) {
+		Ptrace_ref refs;
+		long long n_refs = load_trace(traceFile, &refs);
+
+		run_phases(refs, n_refs, phase_length, phase_clusters,
+				   phase_warmup < 0 ? phase_length : phase_warmup);
+		return 0;
+	}
+	if (prof_path)
+		prof_start();
+	if (n_traces > 1)
+		play_traces();
+	else if (opt_mode)
+		play_trace_opt(traceFile);
+	else
+		play_trace(traceFile);
+	if (prof_path)
+		prof_stop();
 	print_stats();
+	print_owner_stats(traceNames);
+	print_class_stats();
+	print_tlb_stats();
+	print_hotspots(report_top);
+	if (hotspot_path && !write_hotspots(hotspot_path)) {
+		printf("error:  cannot create hotspot file %s\n", hotspot_path);
+		exit(-1);
+	}
+	if (prof_path) {
+		cache_stat inst, data;
+
+		get_cache_stats(&inst, &data);
+		if (!prof_report((long long)inst.accesses + data.accesses, prof_path)) {
+			printf("error:  cannot create profile %s\n", prof_path);
+			exit(-1);
+		}
+	}
+	close_miss_trace();
+	for (i = 0; i < n_traces; i++)
+		if (traceText[i])
+			close_text_trace(traceText[i]);
 
 	return 0;
 }
@@ -33,7 +178,7 @@ char** argv;
 	int arg_index, i, value;
 
 	if (argc < 2) {
-		printf("usage:  sim <options> <trace file>\n");
+		printf("usage:  sim <options> <trace file> [<trace file> ...]\n");
 		exit(-1);
 	}
 
@@ -51,11 +196,54 @@ char** argv;
 			printf("\t-wt: \t\tset write policy to write through\n");
 			printf("\t-wa: \t\tset allocation policy to write allocate\n");
 			printf("\t-nw: \t\tset allocation policy to no write allocate\n");
+			printf("\t-wbuf <n>: \tbuffer written-through stores in <n> combining entries\n");
+			printf("\t-wbd <d>: \tdrain one write buffer entry every <d> cycles\n");
+			printf("\t-wbraw: \tlet fills bypass pending stores in the write buffer\n");
+			printf("\t-ss <ss>: \tsplit cache blocks into <ss> byte sectors\n");
+			printf("\t-hash <h>: \tset the set index function to <h> (plain, xor, prime, skew)\n");
+			printf("\t-mshr <n>: \tmodel a non-blocking cache with <n> MSHRs\n");
+			printf("\t-lat <l>: \tset the miss fill latency to <l> cycles\n");
+			printf("\t-quantum <q>: \treplay <q> references of each trace per turn\n");
+			printf("\t-weights <w,..>: give trace i <w> turns per round\n");
+			printf("\t-occ <n>: \tsample per-trace occupancy every <n> references\n");
+			printf("\t-cat <c>:<m>: \tlet class <c> fill only the ways in hex mask <m>\n");
+			printf("\t-class <c,..>: \tassign trace file i to class <c>\n");
+			printf("\t-opt: \t\talso simulate Belady optimal replacement\n");
+			printf("\t-emit <f>: \twrite the miss and writeback stream to binary trace <f>\n");
+			printf("\t-j <n>: \tparse ASCII traces with <n> threads (0 = read them sequentially)\n");
+			printf("\t-serve <s>: \tkeep the traces loaded and answer requests on socket <s>\n");
+			printf("\t-pool <n>: \tserve requests, run sweeps or a corpus with <n> threads\n");
+			printf("\t-sweep <f>: \trun every configuration of sweep specification <f>\n");
+			printf("\t-store <f>: \tkeep sweep results in <f> and only simulate new points\n");
+			printf("\t-export <f>: \twrite the sweep table to <f> instead of the output\n");
+			printf("\t-phase <n>: \testimate the statistics from representative intervals of <n> references\n");
+			printf("\t-phases <k>: \tgroup the intervals into at most <k> phases\n");
+			printf("\t-warm <n>: \twarm the cache on <n> references before each interval\n");
+			printf("\t-profile <m>: \twrite a statistical model of the trace to <m>\n");
+			printf("\t-clone <m>: \twrite a synthetic binary trace from model <m> to the trace file\n");
+			printf("\t-refs <n>: \tmake the synthetic trace <n> references long\n");
+			printf("\t-delta \"<f>\": \talso run the cache flags <f> and report where the two differ\n");
+			printf("\t-hotspots <f>: \tcount accesses, misses and evictions per set and misses per region,\n");
+			printf("\t\t\tand write them to <f>, CSV if it ends in .csv, else binary\n");
+			printf("\t-self-profile <f>: \ttime the simulator's stages and write flame graph stacks to <f>,\n");
+			printf("\t\t\tin a build made with SELF_PROFILE=1\n");
+			printf("\t-top <n>: \treport the <n> blocks, sets and regions that differ or miss most\n");
+			printf("\t-region <rs>: \tgroup differences and misses into regions of <rs> bytes\n");
+			printf("\t-corpus <p>: \tsimulate every trace in directory or glob <p>, largest first\n");
+			printf("\t- : \t\tas a trace file, read the trace from standard input or a pipe\n");
+			printf("\t-tlb <n>: \ttranslate addresses through <n>-entry I- and D-TLBs\n");
+			printf("\t-tlba <a>: \tset TLB associativity to <a>\n");
+			printf("\t-stlb <n>: \tadd a shared <n>-entry second level TLB\n");
+			printf("\t-stlba <a>: \tset second level TLB associativity to <a>\n");
+			printf("\t-page <ps>: \tset page size to <ps> (4K, 2M or 1G)\n");
+			printf("\t-walk <l>: \tset page walk latency to <l> cycles per level\n");
+			printf("\t-map <p>: \tset page mapping policy to <p> (seq, rand, color)\n");
 			exit(0);
 		}
 
+	// options come first, every argument after them is a trace file
 	arg_index = 1;
-	while (arg_index != argc - 1) {
+	while (arg_index < argc - 1 && argv[arg_index][0] == '-' && argv[arg_index][1]) {
 
 		/* set the cache simulator parameters */
 
@@ -67,21 +255,21 @@ char** argv;
 		}
 
 		if (!strcmp(argv[arg_index], "-us")) {
-			value = atoi(argv[arg_index + 1]);
+			value = size_arg(argv[arg_index + 1]);
 			set_cache_param(CACHE_PARAM_USIZE, value);
 			arg_index += 2;
 			continue;
 		}
 
 		if (!strcmp(argv[arg_index], "-is")) {
-			value = atoi(argv[arg_index + 1]);
+			value = size_arg(argv[arg_index + 1]);
 			set_cache_param(CACHE_PARAM_ISIZE, value);
 			arg_index += 2;
 			continue;
 		}
 
 		if (!strcmp(argv[arg_index], "-ds")) {
-			value = atoi(argv[arg_index + 1]);
+			value = size_arg(argv[arg_index + 1]);
 			set_cache_param(CACHE_PARAM_DSIZE, value);
 			arg_index += 2;
 			continue;
@@ -95,67 +283,601 @@ char** argv;
 		}
 
 		if (!strcmp(argv[arg_index], "-wb")) {
-			set_cache_param(CACHE_PARAM_WRITEBACK, value);
+			set_cache_param(CACHE_PARAM_WRITEBACK, TRUE);
 			arg_index += 1;
 			continue;
 		}
 
 		if (!strcmp(argv[arg_index], "-wt")) {
-			set_cache_param(CACHE_PARAM_WRITETHROUGH, value);
+			set_cache_param(CACHE_PARAM_WRITETHROUGH, TRUE);
 			arg_index += 1;
 			continue;
 		}
 
 		if (!strcmp(argv[arg_index], "-wa")) {
-			set_cache_param(CACHE_PARAM_WRITEALLOC, value);
+			set_cache_param(CACHE_PARAM_WRITEALLOC, TRUE);
 			arg_index += 1;
 			continue;
 		}
 
 		if (!strcmp(argv[arg_index], "-nw")) {
-			set_cache_param(CACHE_PARAM_NOWRITEALLOC, value);
+			set_cache_param(CACHE_PARAM_NOWRITEALLOC, TRUE);
 			arg_index += 1;
 			continue;
 		}
 
+		if (!strcmp(argv[arg_index], "-wbuf")) {
+			value = atoi(argv[arg_index + 1]);
+			set_cache_param(CACHE_PARAM_WBUF_ENTRIES, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-wbd")) {
+			value = atoi(argv[arg_index + 1]);
+			set_cache_param(CACHE_PARAM_WBUF_DRAIN, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-wbraw")) {
+			set_cache_param(CACHE_PARAM_WBUF_BYPASS, TRUE);
+			arg_index += 1;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-ss")) {
+			value = atoi(argv[arg_index + 1]);
+			set_cache_param(CACHE_PARAM_SECTOR_SIZE, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-hash")) {
+			if (!strcmp(argv[arg_index + 1], "plain"))
+				value = INDEX_HASH_PLAIN;
+			else if (!strcmp(argv[arg_index + 1], "xor"))
+				value = INDEX_HASH_XOR;
+			else if (!strcmp(argv[arg_index + 1], "prime"))
+				value = INDEX_HASH_PRIME;
+			else if (!strcmp(argv[arg_index + 1], "skew"))
+				value = INDEX_HASH_SKEW;
+			else {
+				printf("error:  unknown index function %s\n", argv[arg_index + 1]);
+				exit(-1);
+			}
+			set_cache_param(CACHE_PARAM_INDEX_HASH, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-mshr")) {
+			value = atoi(argv[arg_index + 1]);
+			set_cache_param(CACHE_PARAM_MSHRS, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-lat")) {
+			value = atoi(argv[arg_index + 1]);
+			set_cache_param(CACHE_PARAM_FILL_LATENCY, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-quantum")) {
+			sched_quantum = atoi(argv[arg_index + 1]);
+			if (sched_quantum < 1) {
+				printf("error:  quantum must be positive\n");
+				exit(-1);
+			}
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-weights")) {
+			sched_weight_list = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-occ")) {
+			occ_interval = atoi(argv[arg_index + 1]);
+			if (occ_interval < 1) {
+				printf("error:  occupancy interval must be positive\n");
+				exit(-1);
+			}
+			set_cache_param(CACHE_PARAM_OCCUPANCY_INTERVAL, occ_interval);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-cat")) {
+			char* mask;
+			value = (int)strtol(argv[arg_index + 1], &mask, 10);
+			if (*mask != ':') {
+				printf("error:  -cat expects <class>:<way mask>\n");
+				exit(-1);
+			}
+			set_class_ways(value, strtoull(mask + 1, NULL, 16));
+			classifying = TRUE;
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-class")) {
+			trace_class_list = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-opt")) {
+			opt_mode = TRUE;
+			arg_index += 1;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-j")) {
+			parse_threads = atoi(argv[arg_index + 1]);
+			if (parse_threads < 0) {
+				printf("error:  thread count must not be negative\n");
+				exit(-1);
+			}
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-serve")) {
+			server_path = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-sweep")) {
+			sweep_path = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-phase")) {
+			phase_length = atoi(argv[arg_index + 1]);
+			if (phase_length < 1) {
+				printf("error:  phase interval must be positive\n");
+				exit(-1);
+			}
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-phases")) {
+			phase_clusters = atoi(argv[arg_index + 1]);
+			if (phase_clusters < 1) {
+				printf("error:  phase count must be positive\n");
+				exit(-1);
+			}
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-warm")) {
+			phase_warmup = atoi(argv[arg_index + 1]);
+			if (phase_warmup < 0) {
+				printf("error:  warmup must not be negative\n");
+				exit(-1);
+			}
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-profile")) {
+			profile_path = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-clone")) {
+			clone_path = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-refs")) {
+			clone_refs = atoll(argv[arg_index + 1]);
+			if (clone_refs < 0) {
+				printf("error:  reference count must not be negative\n");
+				exit(-1);
+			}
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-delta")) {
+			delta_flags = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-hotspots")) {
+			hotspot_path = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-self-profile") || !strcmp(argv[arg_index], "--self-profile")) {
+			prof_path = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-top")) {
+			report_top = atoi(argv[arg_index + 1]);
+			if (report_top < 1) {
+				printf("error:  top count must be positive\n");
+				exit(-1);
+			}
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-region")) {
+			region_size = size_arg(argv[arg_index + 1]);
+			if (region_size < 1) {
+				printf("error:  region size must be positive\n");
+				exit(-1);
+			}
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-corpus")) {
+			corpus_pattern = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-store")) {
+			store_path = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-export")) {
+			export_path = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-pool")) {
+			server_workers = atoi(argv[arg_index + 1]);
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-emit")) {
+			miss_trace_name = argv[arg_index + 1];
+			arg_index += 2;
+			continue;
+		}
+		if (!strcmp(argv[arg_index], "-tlb")) {
+			value = atoi(argv[arg_index + 1]);
+			set_tlb_param(TLB_PARAM_ENTRIES, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-tlba")) {
+			value = atoi(argv[arg_index + 1]);
+			set_tlb_param(TLB_PARAM_ASSOC, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-stlb")) {
+			value = atoi(argv[arg_index + 1]);
+			set_tlb_param(TLB_PARAM_STLB_ENTRIES, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-stlba")) {
+			value = atoi(argv[arg_index + 1]);
+			set_tlb_param(TLB_PARAM_STLB_ASSOC, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-page")) {
+			value = size_arg(argv[arg_index + 1]);
+			set_tlb_param(TLB_PARAM_PAGE_SIZE, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-walk")) {
+			value = atoi(argv[arg_index + 1]);
+			set_tlb_param(TLB_PARAM_WALK_LATENCY, value);
+			arg_index += 2;
+			continue;
+		}
+
+		if (!strcmp(argv[arg_index], "-map")) {
+			if (!strcmp(argv[arg_index + 1], "seq"))
+				value = PAGE_MAP_SEQUENTIAL;
+			else if (!strcmp(argv[arg_index + 1], "rand"))
+				value = PAGE_MAP_RANDOM;
+			else if (!strcmp(argv[arg_index + 1], "color"))
+				value = PAGE_MAP_COLORING;
+			else {
+				printf("error:  unknown page mapping policy %s\n", argv[arg_index + 1]);
+				exit(-1);
+			}
+			set_tlb_param(TLB_PARAM_MAP_POLICY, value);
+			arg_index += 2;
+			continue;
+		}
+
 		printf("error:  unrecognized flag %s\n", argv[arg_index]);
 		exit(-1);
 
 	}
 
-	dump_settings();
+	// a clone is written to the one trace file named
+	if (clone_path) {
+		if (argc - arg_index != 1) {
+			printf("error:  -clone writes a single trace file\n");
+			exit(-1);
+		}
+		traceNames = argv + arg_index;
+		return;
+	}
+
+	// a corpus names its own traces and runs this configuration on each
+	if (corpus_pattern) {
+		if (tlb_enabled() || opt_mode || miss_trace_name || sweep_path || server_path || delta_flags ||
+			hotspot_path) {
+			printf("error:  -corpus cannot be combined with -tlb, -opt, -emit, -sweep, -serve, -delta or -hotspots\n");
+			exit(-1);
+		}
+		dump_settings();
+		printf("  Corpus: \t%s\n", corpus_pattern);
+		return;
+	}
+
+	/* open the trace files, a sweep may name more */
+	n_traces = argc - arg_index;
+	traceNames = argv + arg_index;
+	if (sweep_path) {
+		read_sweep_spec(sweep_path, &sweep);
+		traceNames = (char**)malloc(sizeof(char*) * (sweep.n_traces + n_traces));
+		memcpy(traceNames, sweep.traces, sizeof(char*) * sweep.n_traces);
+		memcpy(traceNames + sweep.n_traces, argv + arg_index, sizeof(char*) * n_traces);
+		n_traces += sweep.n_traces;
+	}
+	if (n_traces < 1) {
+		printf("error:  no trace file\n");
+		exit(-1);
+	}
+	traceFiles = (FILE**)malloc(sizeof(FILE*) * n_traces);
+	sched_weights = (int*)malloc(sizeof(int) * n_traces);
+	traceBinary = (int*)malloc(sizeof(int) * n_traces);
+	traceText = (Ptext_trace*)malloc(sizeof(Ptext_trace) * n_traces);
+	for (i = 0; i < n_traces; i++) {
+		// "-" reads the trace from a pipe on standard input
+		if (!strcmp(traceNames[i], "-")) {
+#ifdef _WIN32
+			_setmode(_fileno(stdin), _O_BINARY);
+#endif
+			traceFiles[i] = stdin;
+		}
+		else
+			traceFiles[i] = fopen(traceNames[i], "rb");
+		if (!traceFiles[i]) {
+			printf("error:  cannot open trace file %s\n", traceNames[i]);
+			exit(-1);
+		}
+		setvbuf(traceFiles[i], NULL, _IOFBF, TRACE_BUFFER_SIZE);
+		traceBinary[i] = is_binary_trace(traceFiles[i]);
+		traceText[i] = traceBinary[i] ? NULL : open_text_trace(traceFiles[i], parse_threads);
+		sched_weights[i] = 1;
+	}
+	traceFile = traceFiles[0];
 
-	/* open the trace file */
-	traceFile = fopen(argv[arg_index], "r");
+	if (miss_trace_name) {
+		if (!open_miss_trace(miss_trace_name)) {
+			printf("error:  cannot create miss trace %s\n", miss_trace_name);
+			exit(-1);
+		}
+		set_cache_param(CACHE_PARAM_EMIT, TRUE);
+	}
+
+	if (sched_weight_list) {
+		char* w = sched_weight_list;
+		for (i = 0; i < n_traces && *w; i++) {
+			sched_weights[i] = (int)strtol(w, &w, 10);
+			if (sched_weights[i] < 1) {
+				printf("error:  trace weights must be positive\n");
+				exit(-1);
+			}
+			if (*w == ',')
+				w++;
+		}
+	}
+	set_cache_param(CACHE_PARAM_OWNERS, n_traces);
+	if (opt_mode && n_traces > 1) {
+		printf("error:  -opt takes a single trace file\n");
+		exit(-1);
+	}
+	if (sweep_path && server_path) {
+		printf("error:  -sweep and -serve cannot be combined\n");
+		exit(-1);
+	}
+	if ((sweep_path || server_path) &&
+		(opt_mode || miss_trace_name || classifying || trace_class_list || occ_interval)) {
+		printf("error:  -sweep and -serve cannot be combined with -opt, -emit, -cat, -class or -occ\n");
+		exit(-1);
+	}
+	if (profile_path && (n_traces > 1 || opt_mode || miss_trace_name || tlb_enabled() ||
+						 sweep_path || server_path || phase_length)) {
+		printf("error:  -profile takes a single trace file, without -tlb, -opt, -emit, -sweep, -serve or -phase\n");
+		exit(-1);
+	}
+	if (phase_length && (n_traces > 1 || opt_mode || miss_trace_name || tlb_enabled() ||
+						   sweep_path || server_path)) {
+		printf("error:  -phase takes a single trace file, without -tlb, -opt, -emit, -sweep or -serve\n");
+		exit(-1);
+	}
+	if (delta_flags) {
+		if (n_traces > 1 || opt_mode || miss_trace_name || tlb_enabled() || sweep_path ||
+			server_path || profile_path || phase_length) {
+			printf("error:  -delta takes a single trace file, without -tlb, -opt, -emit, -sweep, -serve, -profile or -phase\n");
+			exit(-1);
+		}
+		check_delta_flags(delta_flags);
+	}
+	if (hotspot_path) {
+		if (opt_mode || sweep_path || server_path || profile_path || phase_length || delta_flags) {
+			printf("error:  -hotspots cannot be combined with -opt, -sweep, -serve, -profile, -phase or -delta\n");
+			exit(-1);
+		}
+		set_cache_param(CACHE_PARAM_HOTSPOTS, region_size);
+	}
+	if (prof_path) {
+		if (!prof_compiled()) {
+			printf("error:  -self-profile needs a build made with SELF_PROFILE=1\n");
+			exit(-1);
+		}
+		if (sweep_path || server_path || profile_path || phase_length || delta_flags) {
+			printf("error:  -self-profile cannot be combined with -sweep, -serve, -profile, -phase or -delta\n");
+			exit(-1);
+		}
+	}
+
+	traceClasses = (int*)calloc(n_traces, sizeof(int));
+	if (trace_class_list) {
+		char* c = trace_class_list;
+		for (i = 0; i < n_traces && *c; i++) {
+			traceClasses[i] = (int)strtol(c, &c, 10);
+			if (traceClasses[i] < 0 || traceClasses[i] >= MAX_CACHE_CLASSES) {
+				printf("error:  trace classes must be 0..%d\n", MAX_CACHE_CLASSES - 1);
+				exit(-1);
+			}
+			if (*c == ',')
+				c++;
+		}
+	}
+
+	// sweeps and the server pick their own configurations, a profile
+	// needs none
+	if (sweep_path || server_path || profile_path)
+		return;
+	dump_settings();
+	dump_tlb_settings();
+	if (n_traces > 1) {
+		printf("  Traces: \t%d, quantum %d\n", n_traces, sched_quantum);
+		for (i = 0; i < n_traces; i++)
+			printf("    %s (weight %d)\n", traceNames[i], sched_weights[i]);
+	}
 
 	return;
 }
 /************************************************************/
 
+/************************************************************/
+void simulate_reference(access_type, addr)
+unsigned access_type, addr;
+{
+	unsigned block;
+
+	switch (access_type) {
+	case TRACE_DATA_LOAD:
+	case TRACE_DATA_STORE:
+	case TRACE_INST_LOAD:
+		if (translating)
+			addr = translate(addr, access_type);
+		if (classifying)
+			set_cache_class(trace_element_class >= 0 ?
+							trace_element_class : traceClasses[current_trace]);
+
+		// a run of references to one block takes the cache's repeat path,
+		// which falls back to a full access when the hit is not certain
+		block = cache_block_key(addr, access_type);
+		if (last_valid[access_type] && last_block[access_type] == block)
+			perform_repeat(addr, access_type);
+		else
+			perform_access(addr, access_type);
+		last_block[access_type] = block;
+		last_valid[access_type] = TRUE;
+		break;
+
+	default:
+		printf("skipping access, unknown type(%d)\n", access_type);
+	}
+}
+/************************************************************/
+
+/************************************************************/
+static double seconds()
+{
+	struct timespec ts;
+
+#ifdef _WIN32
+	timespec_get(&ts, TIME_UTC);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void start_progress()
+{
+	long long size;
+	int i;
+
+	trace_bytes = 0;
+	for (i = 0; i < n_traces; i++) {
+		size = trace_file_size(traceFiles[i]);
+		if (size < 0) {
+			trace_bytes = -1;
+			break;
+		}
+		trace_bytes += size;
+	}
+	progress_start = progress_last = seconds();
+}
+
+/* references per second so far, and the time left going by the bytes
+   read, when the size of the traces is known */
+static void report_progress(num_inst)
+long long num_inst;
+{
+	double now = seconds(), elapsed, left;
+	long long offset, at;
+	int i;
+
+	if (now - progress_last < PROGRESS_SECONDS)
+		return;
+	progress_last = now;
+	elapsed = now - progress_start;
+	fprintf(stderr, "processed %lld references, %.2fM refs/s", num_inst, num_inst / elapsed * 1e-6);
+
+	offset = 0;
+	for (i = 0; trace_bytes > 0 && i < n_traces; i++) {
+		at = trace_file_offset(traceFiles[i], traceText[i]);
+		if (at < 0) {
+			offset = -1;
+			break;
+		}
+		offset += at;
+	}
+	if (trace_bytes > 0 && offset > 0) {
+		left = elapsed * (trace_bytes - offset) / offset;
+		fprintf(stderr, ", %.1f%% of %.2f GB, ETA %d:%02d:%02d",
+				100.0 * offset / trace_bytes, trace_bytes / 1073741824.0,
+				(int)left / 3600, (int)left / 60 % 60, (int)left % 60);
+	}
+	fprintf(stderr, "\n");
+}
+/************************************************************/
+
 /************************************************************/
 void play_trace(inFile)
 FILE* inFile;
 {
 	unsigned addr, data, access_type;
-	int num_inst;
+	long long num_inst;
 
+	translating = tlb_enabled();
 	num_inst = 0;
+	start_progress();
 	while (read_trace_element(inFile, &access_type, &addr)) {
 
-		switch (access_type) {
-		case TRACE_DATA_LOAD:
-		case TRACE_DATA_STORE:
-		case TRACE_INST_LOAD:
-			perform_access(addr, access_type);
-			break;
-
-		default:
-			printf("skipping access, unknown type(%d)\n", access_type);
-		}
+		simulate_reference(access_type, addr);
 
 		num_inst++;
-		if (!(num_inst % PRINT_INTERVAL))
-			printf("processed %d references\n", num_inst);
+		if (!(num_inst % PROGRESS_INTERVAL))
+			report_progress(num_inst);
 	}
 
 	flush();
@@ -163,22 +885,132 @@ FILE* inFile;
 /************************************************************/
 
 /************************************************************/
-int read_trace_element(inFile, access_type, addr)
+/* interleave several traces into the shared cache, each trace gets
+   sched_quantum * weight references per turn until it runs out */
+void play_traces()
+{
+	unsigned addr, access_type;
+	long long num_inst;
+	int active, i, k;
+	int* done = (int*)calloc(n_traces, sizeof(int));
+
+	translating = tlb_enabled();
+	num_inst = 0;
+	start_progress();
+	active = n_traces;
+	while (active) {
+		for (i = 0; i < n_traces; i++) {
+			if (done[i])
+				continue;
+
+			set_cache_owner(i);
+			set_tlb_asid(i);
+			current_trace = i;
+			for (k = 0; k < sched_quantum * sched_weights[i]; k++) {
+				if (!read_trace_element(traceFiles[i], &access_type, &addr)) {
+					done[i] = TRUE;
+					active--;
+					break;
+				}
+
+				simulate_reference(access_type, addr);
+
+				num_inst++;
+				if (!(num_inst % PROGRESS_INTERVAL))
+					report_progress(num_inst);
+			}
+		}
+	}
+
+	free(done);
+	flush();
+}
+/************************************************************/
+
+/************************************************************/
+/* parse a size with an optional K, M or G suffix, saturating at the
+   range of a long long */
+long long parse_size(str)
+char* str;
+{
+	char* end;
+	long long value = strtoll(str, &end, 10);
+	int shift = 0;
+
+	switch (*end) {
+	case 'k': case 'K': shift = 10; break;
+	case 'm': case 'M': shift = 20; break;
+	case 'g': case 'G': shift = 30; break;
+	}
+	if (value > LLONG_MAX >> shift)
+		return LLONG_MAX;
+	if (value < LLONG_MIN >> shift)
+		return LLONG_MIN;
+	return value * (1LL << shift);
+}
+
+/* a size on the command line, which the simulator keeps in an int */
+int size_arg(str)
+char* str;
+{
+	long long value = parse_size(str);
+
+	if (value < INT_MIN || value > INT_MAX) {
+		printf("error:  size %s is out of range\n", str);
+		exit(-1);
+	}
+	return (int)value;
+}
+/************************************************************/
+
+/************************************************************/
+static int read_element(inFile, access_type, addr)
 FILE* inFile;
 unsigned* access_type, * addr;
 {
 	int result;
-	char c;
-
-	result = fscanf(inFile, "%u %x%c", access_type, addr, &c);
-	while (c != '\n') {
-		result = fscanf(inFile, "%c", &c);
-		if (result == EOF)
-			break;
+	char c = '\n';
+
+	// an optional decimal field after the address is the class of service
+	trace_element_class = -1;
+	if (traceBinary[current_trace])
+		return read_binary_element(inFile, access_type, addr);
+	if (traceText[current_trace]) {
+		return read_text_element(traceText[current_trace], access_type, addr, &trace_element_class);
 	}
-	if (result != EOF)
-		return(1);
-	else
+	result = fscanf(inFile, "%u %x%c", access_type, addr, &c);
+	if (result == EOF)
 		return(0);
+	while (c == ' ' || c == '\t')
+		c = getc(inFile);
+	if (c >= '0' && c <= '9') {
+		trace_element_class = c - '0';
+		while ((c = getc(inFile)) >= '0' && c <= '9')
+			if (trace_element_class < MAX_CACHE_CLASSES)
+				trace_element_class = trace_element_class * 10 + c - '0';
+		if (trace_element_class >= MAX_CACHE_CLASSES) {
+			printf("error:  trace classes must be 0..%d\n", MAX_CACHE_CLASSES - 1);
+			exit(-1);
+		}
+	}
+	while (c != '\n')
+		if (fscanf(inFile, "%c", &c) == EOF)
+			break;
+	return(1);
+}
+/************************************************************/
+
+/************************************************************/
+/* read one reference, timed as a stage of the self profile */
+int read_trace_element(inFile, access_type, addr)
+FILE* inFile;
+unsigned* access_type, * addr;
+{
+	int more;
+
+	PROF_ENTER(PROF_READ);
+	more = read_element(inFile, access_type, addr);
+	PROF_LEAVE();
+	return more;
 }
 /************************************************************/
@@ -8,9 +8,16 @@
 #define TRACE_DATA_STORE 1
 #define TRACE_INST_LOAD 2
 
-#define PRINT_INTERVAL 100000
+/* the replay checks the clock every PROGRESS_INTERVAL references and
+   reports its progress on stderr every PROGRESS_SECONDS */
+#define PROGRESS_INTERVAL 100000
+#define PROGRESS_SECONDS 5
 
 void parse_args();
 void play_trace();
+void play_traces();
+void simulate_reference();
 int read_trace_element();
+long long parse_size();
+int size_arg();
 
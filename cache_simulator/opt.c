@@ -0,0 +1,119 @@
+/*
+ * opt.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cache.h"
+#include "main.h"
+#include "tlb.h"
+#include "opt.h"
+
+/************************************************************/
+/* read the whole trace into memory, translated when enabled */
+long long load_trace(inFile, refs)
+FILE* inFile;
+Ptrace_ref* refs;
+{
+	unsigned addr, access_type;
+	size_t n = 0, size = 1024;
+	int translating = tlb_enabled();
+
+	*refs = (Ptrace_ref)malloc(sizeof(trace_ref) * size);
+	while (read_trace_element(inFile, &access_type, &addr)) {
+		if (access_type != TRACE_DATA_LOAD && access_type != TRACE_DATA_STORE &&
+			access_type != TRACE_INST_LOAD) {
+			printf("skipping access, unknown type(%d)\n", access_type);
+			continue;
+		}
+
+		if (n == size) {
+			size *= 2;
+			if (size > (size_t)-1 / sizeof(trace_ref) ||
+				!(*refs = (Ptrace_ref)realloc(*refs, sizeof(trace_ref) * size))) {
+				printf("error:  trace of more than %llu references does not fit in memory\n",
+					   (unsigned long long)n);
+				exit(-1);
+			}
+		}
+		if (translating)
+			addr = translate(addr, access_type);
+		(*refs)[n].addr = addr;
+		(*refs)[n].access_type = access_type;
+		n++;
+	}
+	return (long long)n;
+}
+/************************************************************/
+
+/************************************************************/
+/* for each reference find the next one to the same block of the same
+   cache, scanning the trace backwards */
+unsigned long long* compute_next_use(refs, n)
+Ptrace_ref refs;
+long long n;
+{
+	unsigned long long* next = (unsigned long long*)malloc(sizeof(unsigned long long) * (n ? n : 1));
+	Pnext_use_entry table;
+	unsigned key;
+	size_t h, mask, size;
+	long long i;
+
+	for (size = 1024; size < 2 * (size_t)n; size *= 2)
+		;
+	mask = size - 1;
+	table = (Pnext_use_entry)calloc(size, sizeof(next_use_entry));
+
+	for (i = n - 1; i >= 0; i--) {
+		key = cache_block_key(refs[i].addr, refs[i].access_type);
+		h = (size_t)(key * 2654435761u) & mask;
+		while (table[h].valid && table[h].key != key)
+			h = (h + 1) & mask;
+
+		next[i] = table[h].valid ? table[h].index : OPT_NEVER;
+		table[h].key = key;
+		table[h].index = i;
+		table[h].valid = TRUE;
+	}
+
+	free(table);
+	return next;
+}
+/************************************************************/
+
+/************************************************************/
+/* simulate the trace with LRU and print its statistics, then again
+   with Belady's optimal replacement for print_stats to report */
+void play_trace_opt(inFile)
+FILE* inFile;
+{
+	Ptrace_ref refs;
+	unsigned long long* next;
+	long long n, i;
+
+	n = load_trace(inFile, &refs);
+	next = compute_next_use(refs, n);
+
+	for (i = 0; i < n; i++)
+		perform_access(refs[i].addr, refs[i].access_type);
+	flush();
+	print_stats();
+
+	// only the configured cache's miss stream goes to a derived trace
+	set_cache_param(CACHE_PARAM_EMIT, FALSE);
+	set_cache_param(CACHE_PARAM_OPT, TRUE);
+	release_cache();
+	init_cache();
+	for (i = 0; i < n; i++) {
+		set_cache_next_use(next[i]);
+		perform_access(refs[i].addr, refs[i].access_type);
+	}
+	flush();
+
+	printf("\n*** BELADY OPT REPLACEMENT ***\n");
+	free(next);
+	free(refs);
+}
+/************************************************************/
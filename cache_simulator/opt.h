@@ -0,0 +1,23 @@
+/*
+ * opt.h
+ */
+
+
+#define OPT_NEVER 0xFFFFFFFFFFFFFFFFULL	/* next use of a block never touched again */
+
+/* structure definitions */
+typedef struct trace_ref_ {
+  unsigned addr;
+  unsigned access_type;
+} trace_ref, *Ptrace_ref;
+
+typedef struct next_use_entry_ {
+  unsigned key;			/* block key, see cache_block_key */
+  unsigned long long index;	/* reference that touches it next */
+  int valid;
+} next_use_entry, *Pnext_use_entry;
+
+
+/* function prototypes */
+long long load_trace();
+void play_trace_opt();
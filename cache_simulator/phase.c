@@ -0,0 +1,307 @@
+/*
+ * phase.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "cache.h"
+#include "main.h"
+#include "opt.h"
+#include "phase.h"
+
+static Pphase_interval intervals;
+static int n_intervals;
+static Pphase_cluster clusters;
+static int n_clusters;
+
+
+/************************************************************/
+static float distance(a, b)
+float* a;
+float* b;
+{
+	float d = 0, x;
+	int i;
+
+	for (i = 0; i < PHASE_SIGNATURE_DIMS; i++) {
+		x = a[i] - b[i];
+		d += x * x;
+	}
+	return d;
+}
+/************************************************************/
+
+/************************************************************/
+/* hash the blocks each interval touches into its signature. Instruction
+   blocks tell the phases of a program apart, a trace without any falls
+   back to its data blocks */
+static void make_signatures(refs, n_refs, interval)
+Ptrace_ref refs;
+long long n_refs;
+int interval;
+{
+	int use_type = TRACE_INST_LOAD, touched, j, k;
+	Pphase_interval p;
+	unsigned h;
+	long long i;
+
+	for (i = 0; i < n_refs && refs[i].access_type != TRACE_INST_LOAD; i++)
+		;
+	if (i == n_refs)
+		use_type = -1;
+
+	if ((n_refs + interval - 1) / interval > 0x7FFFFFFF) {
+		printf("error:  -phase %d makes too many intervals, take longer ones\n", interval);
+		exit(-1);
+	}
+	n_intervals = (int)((n_refs + interval - 1) / interval);
+	intervals = (Pphase_interval)calloc(n_intervals, sizeof(phase_interval));
+	for (k = 0; k < n_intervals; k++) {
+		p = &intervals[k];
+		p->start = (long long)k * interval;
+		p->length = n_refs - p->start < interval ? n_refs - p->start : interval;
+		touched = 0;
+		for (i = p->start; i < p->start + p->length; i++) {
+			if (use_type >= 0 && refs[i].access_type != (unsigned)use_type)
+				continue;
+			h = (refs[i].addr >> PHASE_SIGNATURE_BLOCK) * 2654435761u;
+			p->signature[h % PHASE_SIGNATURE_DIMS] += 1;
+			touched++;
+		}
+		for (j = 0; touched && j < PHASE_SIGNATURE_DIMS; j++)
+			p->signature[j] /= touched;
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* k-means over the signatures, seeded with the farthest-first intervals.
+   Fewer than max_clusters come out when the intervals run out of
+   distinct signatures */
+static void cluster_intervals(max_clusters)
+int max_clusters;
+{
+	float* nearest = (float*)malloc(sizeof(float) * n_intervals);
+	int changed, iter, far, i, j, c;
+	Pphase_cluster q;
+	float d, best;
+
+	clusters = (Pphase_cluster)calloc(max_clusters, sizeof(phase_cluster));
+	memcpy(clusters[0].centroid, intervals[0].signature, sizeof(clusters[0].centroid));
+	n_clusters = 1;
+	for (i = 0; i < n_intervals; i++)
+		nearest[i] = distance(intervals[i].signature, clusters[0].centroid);
+	while (n_clusters < max_clusters) {
+		for (far = 0, i = 1; i < n_intervals; i++)
+			if (nearest[i] > nearest[far])
+				far = i;
+		if (nearest[far] <= 0)
+			break;
+		q = &clusters[n_clusters++];
+		memcpy(q->centroid, intervals[far].signature, sizeof(q->centroid));
+		for (i = 0; i < n_intervals; i++) {
+			d = distance(intervals[i].signature, q->centroid);
+			if (d < nearest[i])
+				nearest[i] = d;
+		}
+	}
+	free(nearest);
+
+	for (i = 0; i < n_intervals; i++)
+		intervals[i].cluster = -1;
+	for (iter = 0; iter < PHASE_MAX_ITERATIONS; iter++) {
+		changed = FALSE;
+		for (i = 0; i < n_intervals; i++) {
+			for (c = 0, j = 1; j < n_clusters; j++)
+				if (distance(intervals[i].signature, clusters[j].centroid) <
+					distance(intervals[i].signature, clusters[c].centroid))
+					c = j;
+			if (intervals[i].cluster != c) {
+				intervals[i].cluster = c;
+				changed = TRUE;
+			}
+		}
+		if (!changed)
+			break;
+
+		// move each centroid to the mean of its members, an empty
+		// cluster keeps its place
+		for (c = 0; c < n_clusters; c++) {
+			q = &clusters[c];
+			q->members = 0;
+			for (i = 0; i < n_intervals; i++)
+				if (intervals[i].cluster == c) {
+					if (!q->members++)
+						memset(q->centroid, 0, sizeof(q->centroid));
+					for (j = 0; j < PHASE_SIGNATURE_DIMS; j++)
+						q->centroid[j] += intervals[i].signature[j];
+				}
+			for (j = 0; q->members && j < PHASE_SIGNATURE_DIMS; j++)
+				q->centroid[j] /= q->members;
+		}
+	}
+
+	// the representative is the member nearest the centroid, the spare a
+	// member picked at random among the others
+	srand(1);
+	for (c = 0; c < n_clusters; c++) {
+		q = &clusters[c];
+		q->members = 0;
+		q->refs = 0;
+		q->representative = -1;
+		for (i = 0; i < n_intervals; i++) {
+			if (intervals[i].cluster != c)
+				continue;
+			q->members++;
+			q->refs += intervals[i].length;
+			d = distance(intervals[i].signature, q->centroid);
+			if (q->representative < 0 || d < best) {
+				q->representative = i;
+				best = d;
+			}
+		}
+		q->spare = -1;
+		if (q->members > 1) {
+			j = rand() % (q->members - 1);
+			for (i = 0; i < n_intervals; i++)
+				if (intervals[i].cluster == c && i != q->representative && !j--) {
+					q->spare = i;
+					break;
+				}
+		}
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* simulate interval k after warming a fresh cache on the warmup
+   references before it, fill in its figures per reference and return
+   the number of warmup references */
+static long long simulate_interval(refs, k, warmup, rate)
+Ptrace_ref refs;
+int k, warmup;
+double* rate;
+{
+	Pphase_interval p = &intervals[k];
+	long long first = p->start > warmup ? p->start - warmup : 0;
+	cache_stat inst0, data0, inst, data;
+	long long i;
+
+	release_cache();
+	init_cache();
+	for (i = first; i < p->start; i++)
+		perform_access(refs[i].addr, refs[i].access_type);
+	get_cache_stats(&inst0, &data0);
+	for (; i < p->start + p->length; i++)
+		perform_access(refs[i].addr, refs[i].access_type);
+	get_cache_stats(&inst, &data);
+
+	rate[0] = inst.accesses - inst0.accesses;
+	rate[1] = inst.misses - inst0.misses;
+	rate[2] = inst.replacements - inst0.replacements;
+	rate[3] = inst.demand_fetches - inst0.demand_fetches;
+	rate[4] = inst.copies_back - inst0.copies_back;
+	rate[5] = data.accesses - data0.accesses;
+	rate[6] = data.misses - data0.misses;
+	rate[7] = data.replacements - data0.replacements;
+	rate[8] = data.demand_fetches - data0.demand_fetches;
+	rate[9] = data.copies_back - data0.copies_back;
+	for (i = 0; i < PHASE_METRICS; i++)
+		rate[i] /= p->length;
+	return p->start - first;
+}
+/************************************************************/
+
+/************************************************************/
+static void print_rate(est, err, accesses)
+double* est;
+double* err;
+int accesses;
+{
+	double m = est[accesses + 1], a = est[accesses];
+
+	if (a <= 0)
+		printf("  miss rate: 0 (0)\n");
+	else
+		printf("  miss rate: %2.4f +- %2.4f (hit rate %2.4f)\n", m / a, err[accesses + 1] / a,
+			   1.0 - m / a);
+}
+/************************************************************/
+
+/************************************************************/
+/* estimate the statistics of the whole trace from one interval of each
+   phase. Every cluster contributes its representative's figures times its
+   references. The error is one standard error, from the difference
+   between the representative and the spare of each cluster */
+void run_phases(refs, n_refs, interval, max_clusters, warmup)
+Ptrace_ref refs;
+long long n_refs;
+int interval, max_clusters, warmup;
+{
+	double est[PHASE_METRICS], err[PHASE_METRICS], d;
+	long long detailed = 0, warmed = 0;
+	Pphase_cluster q;
+	int c, m;
+
+	if (!n_refs) {
+		printf("error:  empty trace\n");
+		exit(-1);
+	}
+	make_signatures(refs, n_refs, interval);
+	cluster_intervals(max_clusters < n_intervals ? max_clusters : n_intervals);
+
+	memset(est, 0, sizeof(est));
+	memset(err, 0, sizeof(err));
+	for (c = 0; c < n_clusters; c++) {
+		q = &clusters[c];
+		if (!q->members)
+			continue;
+		warmed += simulate_interval(refs, q->representative, warmup, q->rate);
+		detailed += intervals[q->representative].length;
+		if (q->spare >= 0) {
+			warmed += simulate_interval(refs, q->spare, warmup, q->spare_rate);
+			detailed += intervals[q->spare].length;
+		}
+		for (m = 0; m < PHASE_METRICS; m++) {
+			est[m] += q->refs * q->rate[m];
+			if (q->spare >= 0) {
+				d = q->refs * (q->rate[m] - q->spare_rate[m]);
+				err[m] += d * d / 2;
+			}
+		}
+	}
+	for (m = 0; m < PHASE_METRICS; m++)
+		err[m] = sqrt(err[m]);
+
+	printf("\n*** PHASES ***\n");
+	printf("  intervals: \t%d of %d references, warmup %d\n", n_intervals, interval, warmup);
+	printf("  clusters: \t%d\n", n_clusters);
+	printf("  %8s %10s %8s %15s %8s\n", "cluster", "intervals", "weight", "representative", "spare");
+	for (c = 0; c < n_clusters; c++) {
+		q = &clusters[c];
+		if (q->members)
+			printf("  %8d %10d %8.4f %15d %8d\n", c, q->members, (double)q->refs / n_refs,
+				   q->representative, q->spare);
+	}
+	printf("  simulated: \t%lld of %lld references (%.1f%%), %lld more to warm up\n", detailed,
+		   n_refs, 100.0 * detailed / n_refs, warmed);
+
+	printf("\n*** ESTIMATED CACHE STATISTICS ***\n");
+	printf(" INSTRUCTIONS\n");
+	printf("  accesses:  %.0f +- %.0f\n", est[0], err[0]);
+	printf("  misses:    %.0f +- %.0f\n", est[1], err[1]);
+	print_rate(est, err, 0);
+	printf("  replace:   %.0f +- %.0f\n", est[2], err[2]);
+	printf(" DATA\n");
+	printf("  accesses:  %.0f +- %.0f\n", est[5], err[5]);
+	printf("  misses:    %.0f +- %.0f\n", est[6], err[6]);
+	print_rate(est, err, 5);
+	printf("  replace:   %.0f +- %.0f\n", est[7], err[7]);
+	printf(" TRAFFIC (in words)\n");
+	printf("  demand fetch:  %.0f +- %.0f\n", est[3] + est[8], sqrt(err[3] * err[3] + err[8] * err[8]));
+	printf("  copies back:   %.0f +- %.0f\n", est[4] + est[9], sqrt(err[4] * err[4] + err[9] * err[9]));
+}
+/************************************************************/
@@ -0,0 +1,32 @@
+/*
+ * phase.h
+ */
+
+
+#define PHASE_SIGNATURE_DIMS 32		/* buckets of the hashed block vector */
+#define PHASE_SIGNATURE_BLOCK 6		/* log2 of the signature block size */
+#define PHASE_DEFAULT_CLUSTERS 10
+#define PHASE_MAX_ITERATIONS 100	/* k-means passes */
+#define PHASE_METRICS 10		/* the cache_stat figures estimated */
+
+/* structure definitions */
+typedef struct phase_interval_ {
+  float signature[PHASE_SIGNATURE_DIMS];	/* block touches, normalized to sum 1 */
+  long long start;		/* first reference */
+  int length;			/* number of references */
+  int cluster;
+} phase_interval, *Pphase_interval;
+
+typedef struct phase_cluster_ {
+  float centroid[PHASE_SIGNATURE_DIMS];
+  int members;			/* intervals in the cluster */
+  long long refs;		/* references in those intervals */
+  int representative;		/* member closest to the centroid */
+  int spare;			/* second member, to estimate the error, or -1 */
+  double rate[PHASE_METRICS];	/* per reference figures of the representative */
+  double spare_rate[PHASE_METRICS];
+} phase_cluster, *Pphase_cluster;
+
+
+/* function prototypes */
+void run_phases();
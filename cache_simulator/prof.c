@@ -0,0 +1,181 @@
+/*
+ * prof.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PROF_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROF_TSC
+#endif
+
+#include "prof.h"
+
+int prof_enabled;
+
+static char* stage_names[PROF_STAGES] = {
+	"sim", "read_trace_element", "perform_access", "cache_index", "find_line", "lru", "miss"
+};
+
+static prof_node nodes[PROF_MAX_NODES];
+static int n_nodes;
+static int stack[PROF_MAX_DEPTH];
+static int depth;
+static unsigned long long last_tick;
+static unsigned long long start_tick, stop_tick;
+static double start_ns, stop_ns;
+
+
+/************************************************************/
+/* the hooks are compiled in */
+int prof_compiled()
+{
+#ifdef SELF_PROFILE
+	return 1;
+#else
+	return 0;
+#endif
+}
+/************************************************************/
+
+/************************************************************/
+static double wall_ns()
+{
+	struct timespec ts;
+
+#ifdef _WIN32
+	timespec_get(&ts, TIME_UTC);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* the cycle counter where there is one, else nanoseconds */
+static unsigned long long ticks()
+{
+#ifdef PROF_TSC
+	return __rdtsc();
+#else
+	return (unsigned long long)wall_ns();
+#endif
+}
+/************************************************************/
+
+/************************************************************/
+void prof_start()
+{
+	memset(nodes, 0, sizeof(nodes));
+	nodes[0].stage = PROF_DRIVER;
+	n_nodes = 1;
+	stack[0] = 0;
+	depth = 0;
+	start_ns = wall_ns();
+	start_tick = last_tick = ticks();
+	prof_enabled = 1;
+}
+
+void prof_stop()
+{
+	stop_tick = ticks();
+	stop_ns = wall_ns();
+	nodes[stack[depth]].ticks += stop_tick - last_tick;
+	prof_enabled = 0;
+}
+/************************************************************/
+
+/************************************************************/
+/* charge the time so far to the current stack and push stage on it */
+void prof_enter(stage)
+int stage;
+{
+	unsigned long long now = ticks();
+	int cur = stack[depth], next;
+
+	nodes[cur].ticks += now - last_tick;
+	last_tick = now;
+
+	next = nodes[cur].child[stage];
+	if (!next && n_nodes < PROF_MAX_NODES) {
+		next = n_nodes++;
+		nodes[next].stage = stage;
+		nodes[next].parent = cur;
+		nodes[cur].child[stage] = next;
+	}
+	// past the limits the time stays with the enclosing stack
+	if (depth < PROF_MAX_DEPTH - 1)
+		stack[++depth] = next ? next : cur;
+}
+
+void prof_leave()
+{
+	unsigned long long now = ticks();
+
+	nodes[stack[depth]].ticks += now - last_tick;
+	last_tick = now;
+	if (depth)
+		depth--;
+}
+/************************************************************/
+
+/************************************************************/
+static void write_stack(f, node)
+FILE* f;
+int node;
+{
+	if (node)
+		write_stack(f, nodes[node].parent);
+	fprintf(f, node ? ";%s" : "%s", stage_names[nodes[node].stage]);
+}
+
+/* print the time of each stage, and write the stacks to path in the
+   folded format flame graph tools read, one stack and its nanoseconds
+   per line */
+int prof_report(refs, path)
+long long refs;
+char* path;
+{
+	unsigned long long stage_ticks[PROF_STAGES];
+	double elapsed = (stop_ns - start_ns) / 1e9;
+	double ns_per_tick = stop_tick > start_tick ? (stop_ns - start_ns) / (stop_tick - start_tick) : 0;
+	double seconds;
+	FILE* f;
+	int i;
+
+	memset(stage_ticks, 0, sizeof(stage_ticks));
+	for (i = 0; i < n_nodes; i++)
+		stage_ticks[nodes[i].stage] += nodes[i].ticks;
+
+	printf("\n*** SELF PROFILE ***\n");
+	printf("  references: \t%lld\n", refs);
+	printf("  elapsed: \t%.3f s\n", elapsed);
+	printf("  throughput: \t%.0f refs/s\n", elapsed > 0 ? refs / elapsed : 0.0);
+#ifdef PROF_TSC
+	printf("  timer: \trdtsc at %.2f GHz\n", ns_per_tick > 0 ? 1 / ns_per_tick : 0.0);
+#else
+	printf("  timer: \tclock_gettime\n");
+#endif
+	printf("  %-20s %10s %8s %10s\n", "stage", "seconds", "share", "ns/ref");
+	for (i = 0; i < PROF_STAGES; i++) {
+		seconds = stage_ticks[i] * ns_per_tick / 1e9;
+		printf("  %-20s %10.3f %7.1f%% %10.1f\n", stage_names[i], seconds,
+			   elapsed > 0 ? 100 * seconds / elapsed : 0.0, refs ? seconds * 1e9 / refs : 0.0);
+	}
+
+	f = fopen(path, "w");
+	if (!f)
+		return 0;
+	for (i = 0; i < n_nodes; i++)
+		if (nodes[i].ticks) {
+			write_stack(f, i);
+			fprintf(f, " %.0f\n", nodes[i].ticks * ns_per_tick);
+		}
+	fclose(f);
+	return 1;
+}
+/************************************************************/
@@ -0,0 +1,49 @@
+/*
+ * prof.h
+ */
+
+
+/* stages of the simulator the self profile times. Time is charged to
+   the innermost stage entered, so each stage counts its own work only. */
+#define PROF_DRIVER 0			/* the trace loop and everything outside a stage */
+#define PROF_READ 1			/* read_trace_element */
+#define PROF_ACCESS 2			/* the rest of perform_access */
+#define PROF_INDEX 3			/* tag and set index computation */
+#define PROF_LOOKUP 4			/* finding the line in its set */
+#define PROF_LRU 5			/* apply_lru, insert and delete */
+#define PROF_MISS 6			/* allocating and filling a missing line */
+#define PROF_STAGES 7
+
+#define PROF_MAX_NODES 64		/* distinct stacks of stages */
+#define PROF_MAX_DEPTH 16
+
+/* the hooks only exist in a build with SELF_PROFILE defined, make
+   SELF_PROFILE=1, and only time when -self-profile is given */
+#ifdef SELF_PROFILE
+#define PROF_ENTER(stage) do { if (prof_enabled) prof_enter(stage); } while (0)
+#define PROF_LEAVE() do { if (prof_enabled) prof_leave(); } while (0)
+#else
+#define PROF_ENTER(stage) do { } while (0)
+#define PROF_LEAVE() do { } while (0)
+#endif
+
+/* structure definitions */
+
+/* a stack of stages, a node of the tree of the stacks seen */
+typedef struct prof_node_ {
+  int stage;
+  int parent;
+  int child[PROF_STAGES];	/* node of each stage entered from here, 0 if none */
+  unsigned long long ticks;	/* time charged to this stack */
+} prof_node, *Pprof_node;
+
+extern int prof_enabled;
+
+
+/* function prototypes */
+int prof_compiled();
+void prof_start();
+void prof_stop();
+void prof_enter();
+void prof_leave();
+int prof_report();
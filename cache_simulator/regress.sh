@@ -0,0 +1,132 @@
+#!/bin/sh
+#
+# regress.sh test|perf
+#
+# replay every golden output in outputs/ and check that sim prints the
+# same settings and statistics. A file that starts with ./sim command
+# lines holds one case per command; any other is one run, whose flags come
+# from its CACHE SETTINGS header and whose trace is named after the file
+# (public-write1.out replays traces/public-write.trace).
+#
+# perf also times each case and compares refs/sec with perf.baseline,
+# flagging a case that got more than PERF_THRESHOLD percent slower. The
+# baseline is written when there is none, or when PERF_RECORD=1. SIM
+# names another binary to check.
+#
+
+mode=${1:-test}
+sim=${SIM:-./sim}
+baseline=${PERF_BASELINE:-perf.baseline}
+threshold=${PERF_THRESHOLD:-10}		# percent
+min_time=${PERF_TIME:-500}		# milliseconds of repeated runs per case
+min_refs=1000				# shorter cases only time the start-up
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# settings and statistics, without progress lines and blank lines
+filter() {
+	grep -v '^processed' | sed '/^[[:space:]]*$/d'
+}
+
+# sim flags that reproduce a CACHE SETTINGS header
+header_flags() {
+	awk '
+		/\*\*\* CACHE STATISTICS/ || /^processed/ { exit }
+		/^  Size:/ { f = f " -us " $NF }
+		/^  I-cache size:/ { f = f " -is " $NF }
+		/^  D-cache size:/ { f = f " -ds " $NF }
+		/^  Associativity:/ { f = f " -a " $NF }
+		/^  Block size:/ { f = f " -bs " $NF }
+		/^  Write policy:/ { f = f ($NF == "BACK" ? " -wb" : " -wt") }
+		/^  Allocation policy:/ { f = f ($0 ~ /NO ALLOCATE/ ? " -nw" : " -wa") }
+		/^  Sector size:/ { f = f " -ss " $NF }
+		/^  Index function:/ { f = f ($0 ~ /XOR/ ? " -hash xor" : $0 ~ /PRIME/ ? " -hash prime" : " -hash skew") }
+		/^  Write buffer:/ { f = f " -wbuf " $3 " -wbd " $5; if ($0 ~ /bypass/) f = f " -wbraw" }
+		/^  MSHRs:/ { f = f " -mshr " $NF }
+		/^  Fill latency:/ { f = f " -lat " $NF }
+		END { print substr(f, 2) }' "$1"
+}
+
+# one line per case: name, command, output file, first and last line
+list_cases() {
+	for out in outputs/*.out; do
+		name=$(basename "$out" .out)
+		if grep -q '^\./sim ' "$out"; then
+			awk -v name="$name" -v out="$out" '
+				/^\.\/sim / {
+					if (cmd != "") print name ":" ++n "\t" cmd "\t" out "\t" start "\t" NR - 1
+					cmd = $0; start = NR + 1; next
+				}
+				END { if (cmd != "") print name ":" ++n "\t" cmd "\t" out "\t" start "\t" NR }' "$out"
+		else
+			trace=traces/$name.trace
+			[ -f "$trace" ] || trace=traces/${name%1}.trace
+			if [ ! -f "$trace" ]; then
+				echo "SKIP $name: no trace for it in traces/" >&2
+				continue
+			fi
+			printf '%s\t%s\t%s\t%s\t%s\n' "$name" "./sim $(header_flags "$out") $trace" \
+				"$out" 1 "$(wc -l < "$out")"
+		fi
+	done
+}
+
+now_ns() {
+	date +%s%N
+}
+
+list_cases > "$tmp/cases"
+n=0
+fail=0
+slow=0
+tab=$(printf '\t')
+while IFS="$tab" read -r name cmd out first last; do
+	n=$((n + 1))
+	run="$sim ${cmd#./sim }"
+	sed -n "${first},${last}p" "$out" | filter > "$tmp/expected"
+	$run < /dev/null 2> /dev/null | filter > "$tmp/got"
+	if ! cmp -s "$tmp/expected" "$tmp/got"; then
+		fail=$((fail + 1))
+		echo "FAIL $name: $cmd"
+		diff "$tmp/expected" "$tmp/got" | head -10
+		continue
+	fi
+	[ "$mode" = perf ] || continue
+
+	# refs/sec over repeated runs, start-up included
+	refs=$(awk '/^\*\*\* CACHE STATISTICS/ { s = 1 } s && /^  accesses:/ { r += $NF } /^ TRAFFIC/ { exit } END { print r + 0 }' "$tmp/got")
+	if [ "$refs" -lt $min_refs ]; then
+		echo "ok   $name: $refs references, too few to time"
+		continue
+	fi
+	runs=0
+	start=$(now_ns)
+	while :; do
+		$run < /dev/null > /dev/null 2>&1
+		runs=$((runs + 1))
+		elapsed=$(( $(now_ns) - start ))
+		[ $elapsed -ge $((min_time * 1000000)) ] && break
+	done
+	rate=$((runs * refs * 1000 / (elapsed / 1000000 + 1)))
+	printf '%s\t%d\n' "$name" "$rate" >> "$tmp/rates"
+
+	base=$(awk -v name="$name" '$1 == name { print $2 }' "$baseline" 2> /dev/null)
+	if [ -n "$base" ] && [ $((rate * 100)) -lt $((base * (100 - threshold))) ]; then
+		slow=$((slow + 1))
+		echo "SLOW $name: $rate refs/s, baseline $base refs/s"
+	else
+		echo "ok   $name: $rate refs/s${base:+, baseline $base refs/s}"
+	fi
+done < "$tmp/cases"
+
+echo "$n cases, $fail failures"
+if [ "$mode" = perf ]; then
+	if [ ! -f "$baseline" ] || [ "${PERF_RECORD:-0}" = 1 ]; then
+		cp "$tmp/rates" "$baseline"
+		echo "recorded $baseline"
+	else
+		echo "$slow cases more than $threshold% below $baseline"
+	fi
+fi
+[ $fail -eq 0 ] && [ $slow -eq 0 ]
@@ -0,0 +1,434 @@
+/*
+ * server.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "cache.h"
+#include "main.h"
+#include "opt.h"
+#include "server.h"
+
+/************************************************************/
+/* the checks set_cache_param and init_cache make, which would exit
+   instead of rejecting the one configuration. Returns an error message
+   or NULL. */
+char* check_config(cfg)
+Psim_config cfg;
+{
+	int i, size;
+
+	if (cfg->block_size < WORD_SIZE || (cfg->block_size & (cfg->block_size - 1)))
+		return "block size must be a power of two of at least 4";
+	if (cfg->assoc < 1)
+		return "associativity must be positive";
+	for (i = 0; i < 3; i++) {
+		size = i == 0 ? cfg->usize : i == 1 ? cfg->isize : cfg->dsize;
+		if ((i == 0) != (cfg->usize != 0))
+			continue;
+		if (size < cfg->assoc * cfg->block_size || size % (cfg->assoc * cfg->block_size))
+			return "cache size is not a multiple of associativity * block size";
+	}
+	if (cfg->sector_size && (cfg->sector_size > cfg->block_size ||
+							 cfg->block_size / cfg->sector_size > MAX_CACHE_SECTORS))
+		return "sector size must divide the block size into 1..64 sectors";
+	if (cfg->sector_size && cfg->sector_size != cfg->block_size && cfg->index_hash == INDEX_HASH_SKEW)
+		return "sectored skewed-associative caches are not supported";
+	return NULL;
+}
+/************************************************************/
+
+/************************************************************/
+/* the parameters a request or sweep point does not name, from the
+   configuration of the command line */
+void config_params(cfg, p)
+Psim_config cfg;
+Pcache_params p;
+{
+	cfg->index_hash = p->index_hash;
+	cfg->sector_size = p->sector_size;
+	cfg->mshrs = p->mshrs;
+	cfg->fill_latency = p->fill_latency;
+	cfg->wbuf_entries = p->wbuf_entries;
+	cfg->wbuf_drain = p->wbuf_drain;
+	cfg->wbuf_bypass = p->wbuf_bypass;
+}
+/************************************************************/
+
+/************************************************************/
+/* run a resident trace through a configuration on this thread's cache
+   model, which holds the configuration of the command line */
+void simulate_resident(cfg, refs, n_refs, inst, data)
+Psim_config cfg;
+Ptrace_ref refs;
+long long n_refs;
+Pcache_stat inst, data;
+{
+	long long i;
+
+	set_cache_param(CACHE_PARAM_BLOCK_SIZE, cfg->block_size);
+	if (cfg->usize)
+		set_cache_param(CACHE_PARAM_USIZE, cfg->usize);
+	else {
+		set_cache_param(CACHE_PARAM_ISIZE, cfg->isize);
+		set_cache_param(CACHE_PARAM_DSIZE, cfg->dsize);
+	}
+	set_cache_param(CACHE_PARAM_ASSOC, cfg->assoc);
+	set_cache_param(cfg->writeback ? CACHE_PARAM_WRITEBACK : CACHE_PARAM_WRITETHROUGH, TRUE);
+	set_cache_param(cfg->writealloc ? CACHE_PARAM_WRITEALLOC : CACHE_PARAM_NOWRITEALLOC, TRUE);
+
+	init_cache();
+	for (i = 0; i < n_refs; i++)
+		perform_access(refs[i].addr, refs[i].access_type);
+	flush();
+	get_cache_stats(inst, data);
+	release_cache();
+}
+/************************************************************/
+
+#ifndef _WIN32
+/* the traces every request runs against, loaded once */
+static Ptrace_ref* server_refs;
+static long long* server_n_refs;
+static char** server_names;
+static int server_traces;
+static cache_params server_params;	/* the configuration of the command line */
+
+/* results of the configurations simulated so far */
+static Pmemo_entry memo[SERVER_MEMO_BUCKETS];
+static pthread_mutex_t memo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* accepted connections waiting for a worker */
+static int conn_queue[SERVER_QUEUE];
+static int conn_head;
+static int conn_count;
+static pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t conn_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t conn_space = PTHREAD_COND_INITIALIZER;
+
+
+/************************************************************/
+/* read a request in the vocabulary of the command line flags, returns
+   an error message or NULL */
+static char* parse_request(line, cfg)
+char* line;
+Psim_config cfg;
+{
+	char* tok[64];
+	char* save;
+	long long size;
+	int n = 0, i, split = server_params.split;
+
+	// what a request leaves out is as on the command line
+	cfg->trace = 0;
+	cfg->block_size = server_params.block_size;
+	cfg->usize = server_params.usize;
+	cfg->isize = server_params.isize;
+	cfg->dsize = server_params.dsize;
+	cfg->assoc = server_params.assoc;
+	cfg->writeback = server_params.writeback;
+	cfg->writealloc = server_params.writealloc;
+	config_params(cfg, &server_params);
+
+	for (tok[n] = strtok_r(line, " \t\r\n", &save); tok[n] && n < 63; )
+		tok[++n] = strtok_r(NULL, " \t\r\n", &save);
+
+	for (i = 0; i < n; i++) {
+		if (!strcmp(tok[i], "-wb"))
+			cfg->writeback = TRUE;
+		else if (!strcmp(tok[i], "-wt"))
+			cfg->writeback = FALSE;
+		else if (!strcmp(tok[i], "-wa"))
+			cfg->writealloc = TRUE;
+		else if (!strcmp(tok[i], "-nw"))
+			cfg->writealloc = FALSE;
+		else if (strcmp(tok[i], "-bs") && strcmp(tok[i], "-us") && strcmp(tok[i], "-is") &&
+				 strcmp(tok[i], "-ds") && strcmp(tok[i], "-a") && strcmp(tok[i], "-t"))
+			return "unrecognized flag";
+		else if (i + 1 == n)
+			return "flag without a value";
+		else if (strcmp(tok[i], "-a") && strcmp(tok[i], "-t") &&
+				 ((size = parse_size(tok[i + 1])) < INT_MIN || size > INT_MAX))
+			return "size out of range";
+		else if (!strcmp(tok[i], "-bs"))
+			cfg->block_size = (int)parse_size(tok[++i]);
+		else if (!strcmp(tok[i], "-us")) {
+			cfg->usize = (int)parse_size(tok[++i]);
+			split = FALSE;
+		}
+		else if (!strcmp(tok[i], "-is")) {
+			cfg->isize = (int)parse_size(tok[++i]);
+			split = TRUE;
+		}
+		else if (!strcmp(tok[i], "-ds")) {
+			cfg->dsize = (int)parse_size(tok[++i]);
+			split = TRUE;
+		}
+		else if (!strcmp(tok[i], "-a"))
+			cfg->assoc = atoi(tok[++i]);
+		else if (!strcmp(tok[i], "-t")) {
+			// a trace by position or by the name it was loaded under
+			i++;
+			for (cfg->trace = 0; cfg->trace < server_traces; cfg->trace++)
+				if (!strcmp(tok[i], server_names[cfg->trace]))
+					break;
+			if (cfg->trace == server_traces)
+				cfg->trace = tok[i][0] >= '0' && tok[i][0] <= '9' ? atoi(tok[i]) : -1;
+			if (cfg->trace < 0 || cfg->trace >= server_traces)
+				return "unknown trace";
+		}
+	}
+
+	if (split)
+		cfg->usize = 0;
+	else
+		cfg->isize = cfg->dsize = 0;
+	return check_config(cfg);
+}
+/************************************************************/
+
+/************************************************************/
+static unsigned memo_hash(cfg)
+Psim_config cfg;
+{
+	unsigned* w = (unsigned*)cfg;
+	unsigned h = 2166136261u;
+	int i;
+
+	for (i = 0; i < (int)(sizeof(sim_config) / sizeof(unsigned)); i++)
+		h = (h ^ w[i]) * 16777619u;
+	return h % SERVER_MEMO_BUCKETS;
+}
+/************************************************************/
+
+/************************************************************/
+/* simulate a configuration on this thread's cache model, unless it has
+   been simulated before. Returns TRUE for a remembered result. */
+static int simulate_config(cfg, inst, data)
+Psim_config cfg;
+Pcache_stat inst, data;
+{
+	unsigned h = memo_hash(cfg);
+	Pmemo_entry e;
+
+	pthread_mutex_lock(&memo_lock);
+	for (e = memo[h]; e && memcmp(&e->config, cfg, sizeof(sim_config)); e = e->next)
+		;
+	if (e) {
+		*inst = e->inst;
+		*data = e->data;
+	}
+	pthread_mutex_unlock(&memo_lock);
+	if (e)
+		return TRUE;
+
+	simulate_resident(cfg, server_refs[cfg->trace], server_n_refs[cfg->trace], inst, data);
+
+	e = (Pmemo_entry)malloc(sizeof(memo_entry));
+	e->config = *cfg;
+	e->inst = *inst;
+	e->data = *data;
+	pthread_mutex_lock(&memo_lock);
+	e->next = memo[h];
+	memo[h] = e;
+	pthread_mutex_unlock(&memo_lock);
+	return FALSE;
+}
+/************************************************************/
+
+/************************************************************/
+/* one line of JSON with the figures print_stats reports */
+static void write_result(out, cfg, cached, inst, data)
+FILE* out;
+Psim_config cfg;
+int cached;
+Pcache_stat inst, data;
+{
+	const char* c;
+	int i;
+
+	fprintf(out, "{\"trace\":\"");
+	for (c = server_names[cfg->trace]; *c; c++)
+		fprintf(out, *c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+	fprintf(out, "\",\"config\":{\"bs\":%d,\"us\":%d,\"is\":%d,\"ds\":%d,\"a\":%d,\"wb\":%d,\"wa\":%d}",
+		cfg->block_size, cfg->usize, cfg->isize, cfg->dsize, cfg->assoc, cfg->writeback, cfg->writealloc);
+	fprintf(out, ",\"cached\":%s", cached ? "true" : "false");
+	for (i = 0; i < 2; i++) {
+		Pcache_stat s = i ? data : inst;
+		fprintf(out, ",\"%s\":{\"accesses\":%lld,\"misses\":%lld,\"miss_rate\":%.4f,\"replace\":%lld}",
+			i ? "data" : "instructions", s->accesses, s->misses,
+			s->accesses ? (float)s->misses / (float)s->accesses : 0.0, s->replacements);
+	}
+	fprintf(out, ",\"traffic\":{\"demand_fetch\":%lld,\"copies_back\":%lld}}\n",
+		inst->demand_fetches + data->demand_fetches, inst->copies_back + data->copies_back);
+}
+/************************************************************/
+
+/************************************************************/
+/* answer the requests of one connection, a line each */
+static void serve_connection(fd)
+int fd;
+{
+	FILE* in;
+	FILE* out;
+	char line[SERVER_LINE_SIZE];
+	sim_config cfg;
+	cache_stat inst, data;
+	char* error;
+	int cached, c, out_fd;
+	size_t len;
+
+	// without a descriptor to spare the connection is dropped
+	out_fd = dup(fd);
+	in = fdopen(fd, "r");
+	out = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+	if (!in || !out) {
+		if (in)
+			fclose(in);
+		else
+			close(fd);
+		if (out)
+			fclose(out);
+		else if (out_fd >= 0)
+			close(out_fd);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), in)) {
+		// a line that does not fit is answered once, not in pieces
+		len = strlen(line);
+		if (len && line[len - 1] != '\n' && (c = getc(in)) != EOF && c != '\n') {
+			while ((c = getc(in)) != EOF && c != '\n')
+				;
+			fprintf(out, "{\"error\":\"request line too long\"}\n");
+			if (fflush(out))
+				break;
+			continue;
+		}
+		if (strspn(line, " \t\r\n") == strlen(line))
+			continue;
+		error = parse_request(line, &cfg);
+		if (error)
+			fprintf(out, "{\"error\":\"%s\"}\n", error);
+		else {
+			cached = simulate_config(&cfg, &inst, &data);
+			write_result(out, &cfg, cached, &inst, &data);
+		}
+		if (fflush(out))
+			break;
+	}
+	fclose(out);
+	fclose(in);
+}
+/************************************************************/
+
+/************************************************************/
+static void* server_worker(arg)
+void* arg;
+{
+	int fd;
+
+	(void)arg;
+	load_cache_params(&server_params);
+	for (;;) {
+		pthread_mutex_lock(&conn_lock);
+		while (!conn_count)
+			pthread_cond_wait(&conn_ready, &conn_lock);
+		fd = conn_queue[conn_head];
+		conn_head = (conn_head + 1) % SERVER_QUEUE;
+		conn_count--;
+		pthread_cond_signal(&conn_space);
+		pthread_mutex_unlock(&conn_lock);
+
+		serve_connection(fd);
+	}
+	return NULL;
+}
+/************************************************************/
+#endif
+
+/************************************************************/
+/* keep the traces resident and answer configuration requests on a Unix
+   domain socket, each connection served by one of workers threads */
+void run_server(path, workers, refs, n_refs, names, n_traces)
+char* path;
+int workers;
+Ptrace_ref* refs;
+long long* n_refs;
+char** names;
+int n_traces;
+{
+#ifdef _WIN32
+	printf("error:  server mode needs Unix domain sockets\n");
+	exit(-1);
+#else
+	struct sockaddr_un sa;
+	pthread_t thread;
+	int sock, fd, i;
+
+	server_refs = refs;
+	server_n_refs = n_refs;
+	server_names = names;
+	server_traces = n_traces;
+	save_cache_params(&server_params);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sa.sun_path)) {
+		printf("error:  socket path %s is too long\n", path);
+		exit(-1);
+	}
+	strcpy(sa.sun_path, path);
+	unlink(path);
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0 || bind(sock, (struct sockaddr*)&sa, sizeof(sa)) || listen(sock, SERVER_QUEUE)) {
+		printf("error:  cannot listen on %s\n", path);
+		exit(-1);
+	}
+
+	// a client that goes away must not take the server with it
+	signal(SIGPIPE, SIG_IGN);
+
+	if (workers < 1)
+		workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	for (i = 0; i < workers; i++) {
+		pthread_create(&thread, NULL, server_worker, NULL);
+		pthread_detach(thread);
+	}
+	printf("serving %d trace(s) on %s with %d workers\n", n_traces, path, workers);
+	fflush(stdout);
+
+	for (;;) {
+		fd = accept(sock, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			// out of descriptors, most likely: wait for connections to close
+			printf("error:  accept on %s: %s\n", path, strerror(errno));
+			fflush(stdout);
+			sleep(1);
+			continue;
+		}
+
+		pthread_mutex_lock(&conn_lock);
+		while (conn_count == SERVER_QUEUE)
+			pthread_cond_wait(&conn_space, &conn_lock);
+		conn_queue[(conn_head + conn_count) % SERVER_QUEUE] = fd;
+		conn_count++;
+		pthread_cond_signal(&conn_ready);
+		pthread_mutex_unlock(&conn_lock);
+	}
+#endif
+}
+/************************************************************/
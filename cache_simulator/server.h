@@ -0,0 +1,41 @@
+/*
+ * server.h
+ */
+
+
+#define SERVER_QUEUE 16			/* accepted connections waiting for a worker */
+#define SERVER_MEMO_BUCKETS 1024
+#define SERVER_LINE_SIZE 1024		/* longest request line */
+
+/* structure definitions */
+typedef struct sim_config_ {
+  int trace;			/* index of the resident trace */
+  int block_size;
+  int usize;			/* 0 for a split cache */
+  int isize;
+  int dsize;
+  int assoc;
+  int writeback;
+  int writealloc;
+  int index_hash;		/* the rest as given on the command line */
+  int sector_size;
+  int mshrs;
+  int fill_latency;
+  int wbuf_entries;
+  int wbuf_drain;
+  int wbuf_bypass;
+} sim_config, *Psim_config;
+
+typedef struct memo_entry_ {
+  sim_config config;
+  cache_stat inst;
+  cache_stat data;
+  struct memo_entry_* next;
+} memo_entry, *Pmemo_entry;
+
+
+/* function prototypes */
+char* check_config();
+void config_params();
+void simulate_resident();
+void run_server();
@@ -0,0 +1,446 @@
+/*
+ * sweep.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "cache.h"
+#include "main.h"
+#include "opt.h"
+#include "server.h"
+#include "sweep.h"
+
+#ifdef _WIN32
+#define strtok_r strtok_s
+#endif
+
+/* the points of a sweep still to be simulated */
+static sim_config* todo_configs;
+static Psweep_result* todo_results;
+static int n_todo;
+static int next_todo;
+static Ptrace_ref* sweep_refs;
+static long long* sweep_n_refs;
+static cache_params sweep_params;	/* the configuration of the command line */
+#ifndef _WIN32
+static pthread_mutex_t todo_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+/************************************************************/
+/* the values of one parameter: sizes, or lo..hi ranges stepping *k or +k */
+static void parse_dim(dim, tok, n, line_no)
+sweep_dim* dim;
+char** tok;
+int n, line_no;
+{
+	char* range;
+	char* step;
+	long long lo, top;
+	int i, v, hi, k;
+
+	for (i = 0; i < n; i++) {
+		range = strstr(tok[i], "..");
+		lo = parse_size(tok[i]);
+		top = range ? parse_size(range + 2) : lo;
+		if (lo < INT_MIN || lo > INT_MAX || top < INT_MIN || top > INT_MAX) {
+			printf("error:  size out of range on line %d of the sweep\n", line_no);
+			exit(-1);
+		}
+		v = (int)lo;
+		hi = (int)top;
+		if (!range) {
+			k = 1;
+			step = "+";
+		}
+		else {
+			step = strpbrk(range + 2, "*+");
+			k = step ? atoi(step + 1) : 1;
+			if (!step)
+				step = "+";
+			if (k < (*step == '*' ? 2 : 1)) {
+				printf("error:  bad range step on line %d of the sweep\n", line_no);
+				exit(-1);
+			}
+		}
+
+		for (; v <= hi; v = *step == '*' ? v * k : v + k) {
+			if (dim->n == SWEEP_MAX_VALUES) {
+				printf("error:  more than %d values on line %d of the sweep\n", SWEEP_MAX_VALUES, line_no);
+				exit(-1);
+			}
+			dim->value[dim->n++] = v;
+			if (v <= 0 || v == hi)
+				break;
+			if (*step == '*' ? v > INT_MAX / k : v > INT_MAX - k) {
+				printf("error:  bad range step on line %d of the sweep\n", line_no);
+				exit(-1);
+			}
+		}
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* read a sweep specification, one parameter per line:
+     trace <file> ...	traces to run, besides those on the command line
+     bs|us|is|ds|a <values>	block size, cache sizes, associativity
+     write wb|wt ...	write policies
+     alloc wa|nw ...	allocation policies
+   Every combination of the values is a point of the sweep. */
+void read_sweep_spec(path, spec)
+char* path;
+Psweep_spec spec;
+{
+	char line[SWEEP_LINE_SIZE];
+	char* tok[SWEEP_MAX_VALUES + 1];
+	char* save;
+	FILE* f = fopen(path, "r");
+	int n, i, line_no = 0;
+
+	if (!f) {
+		printf("error:  cannot open sweep %s\n", path);
+		exit(-1);
+	}
+	memset(spec, 0, sizeof(sweep_spec));
+
+	while (fgets(line, sizeof(line), f)) {
+		line_no++;
+		if (strchr(line, '#'))
+			*strchr(line, '#') = 0;
+		n = 0;
+		for (tok[n] = strtok_r(line, " \t\r\n", &save); tok[n] && n < SWEEP_MAX_VALUES; )
+			tok[++n] = strtok_r(NULL, " \t\r\n", &save);
+		if (n == 0)
+			continue;
+
+		if (!strcmp(tok[0], "trace")) {
+			for (i = 1; i < n && spec->n_traces < SWEEP_MAX_TRACES; i++)
+				spec->traces[spec->n_traces++] = strdup(tok[i]);
+		}
+		else if (!strcmp(tok[0], "bs"))
+			parse_dim(&spec->block_size, tok + 1, n - 1, line_no);
+		else if (!strcmp(tok[0], "us"))
+			parse_dim(&spec->usize, tok + 1, n - 1, line_no);
+		else if (!strcmp(tok[0], "is"))
+			parse_dim(&spec->isize, tok + 1, n - 1, line_no);
+		else if (!strcmp(tok[0], "ds"))
+			parse_dim(&spec->dsize, tok + 1, n - 1, line_no);
+		else if (!strcmp(tok[0], "a"))
+			parse_dim(&spec->assoc, tok + 1, n - 1, line_no);
+		else if (!strcmp(tok[0], "write") || !strcmp(tok[0], "alloc")) {
+			sweep_dim* dim = tok[0][0] == 'w' ? &spec->writeback : &spec->writealloc;
+			for (i = 1; i < n; i++) {
+				if (!strcmp(tok[i], "wb") || !strcmp(tok[i], "wa"))
+					dim->value[dim->n++] = TRUE;
+				else if (!strcmp(tok[i], "wt") || !strcmp(tok[i], "nw"))
+					dim->value[dim->n++] = FALSE;
+				else {
+					printf("error:  unknown policy %s on line %d of the sweep\n", tok[i], line_no);
+					exit(-1);
+				}
+				if (dim->n == 2)
+					break;
+			}
+		}
+		else {
+			printf("error:  unknown sweep parameter %s on line %d\n", tok[0], line_no);
+			exit(-1);
+		}
+	}
+	fclose(f);
+
+	if (spec->usize.n && (spec->isize.n || spec->dsize.n)) {
+		printf("error:  a sweep has either a unified or split caches\n");
+		exit(-1);
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* FNV-1a hash of the references of a trace, so a result stays valid
+   for the same trace under another name or format */
+static void trace_hash(refs, n, hash)
+Ptrace_ref refs;
+long long n;
+char* hash;
+{
+	unsigned long long h = 14695981039346656037ull;
+	long long i;
+
+	for (i = 0; i < n; i++) {
+		h = (h ^ refs[i].addr) * 1099511628211ull;
+		h = (h ^ refs[i].access_type) * 1099511628211ull;
+	}
+	sprintf(hash, "%016llx", h);
+}
+/************************************************************/
+
+/************************************************************/
+/* results already in the store, a CSV file appended to by every sweep.
+   The store only keeps the total traffic, read back as data traffic. */
+static Psweep_result read_store(path)
+char* path;
+{
+	char line[SWEEP_LINE_SIZE];
+	Psweep_result head = NULL, r;
+	FILE* f = path ? fopen(path, "r") : NULL;
+	Psim_config c;
+
+	if (!f)
+		return NULL;
+	while (fgets(line, sizeof(line), f)) {
+		r = (Psweep_result)calloc(1, sizeof(sweep_result));
+		c = &r->config;
+		if (sscanf(line, "%16[0-9a-f],%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,"
+				   "%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld", r->hash,
+				   &c->block_size, &c->usize, &c->isize, &c->dsize, &c->assoc, &c->writeback,
+				   &c->writealloc, &c->index_hash, &c->sector_size, &c->mshrs, &c->fill_latency,
+				   &c->wbuf_entries, &c->wbuf_drain, &c->wbuf_bypass,
+				   &r->inst.accesses, &r->inst.misses, &r->inst.replacements,
+				   &r->data.accesses, &r->data.misses, &r->data.replacements,
+				   &r->data.demand_fetches, &r->data.copies_back) != 23) {
+			// the header, or a damaged line
+			free(r);
+			continue;
+		}
+		r->next = head;
+		head = r;
+	}
+	fclose(f);
+	return head;
+}
+/************************************************************/
+
+/************************************************************/
+static void write_store_row(f, r, name)
+FILE* f;
+Psweep_result r;
+char* name;
+{
+	Psim_config c = &r->config;
+
+	fprintf(f, "%s,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%s\n",
+			r->hash, c->block_size, c->usize, c->isize, c->dsize, c->assoc, c->writeback, c->writealloc,
+			c->index_hash, c->sector_size, c->mshrs, c->fill_latency,
+			c->wbuf_entries, c->wbuf_drain, c->wbuf_bypass,
+			r->inst.accesses, r->inst.misses, r->inst.replacements,
+			r->data.accesses, r->data.misses, r->data.replacements,
+			r->inst.demand_fetches + r->data.demand_fetches,
+			r->inst.copies_back + r->data.copies_back, name);
+}
+/************************************************************/
+
+/************************************************************/
+/* simulate the points not in the store, one at a time per thread */
+static void* sweep_worker(arg)
+void* arg;
+{
+	Psweep_result r;
+	sim_config c;
+	int k;
+
+	(void)arg;
+	load_cache_params(&sweep_params);
+	for (;;) {
+#ifndef _WIN32
+		pthread_mutex_lock(&todo_lock);
+#endif
+		k = next_todo++;
+#ifndef _WIN32
+		pthread_mutex_unlock(&todo_lock);
+#endif
+		if (k >= n_todo)
+			return NULL;
+
+		r = todo_results[k];
+		c = todo_configs[k];
+		simulate_resident(&c, sweep_refs[c.trace], sweep_n_refs[c.trace], &r->inst, &r->data);
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* the configuration of the command line, kept for the workers */
+static Pcache_params command_line()
+{
+	save_cache_params(&sweep_params);
+	return &sweep_params;
+}
+
+/* the values of a swept parameter, or else one, its value on the
+   command line */
+static sweep_dim* swept(dim, one, value)
+sweep_dim* dim;
+sweep_dim* one;
+int value;
+{
+	one->n = 1;
+	one->value[0] = value;
+	return dim->n ? dim : one;
+}
+/************************************************************/
+
+/************************************************************/
+/* run every point of the sweep that the store does not hold yet, add
+   the new results to the store and export the table of the sweep */
+void run_sweep(spec, store_path, export_path, workers, refs, n_refs, names, n_traces)
+Psweep_spec spec;
+char* store_path;
+char* export_path;
+int workers;
+Ptrace_ref* refs;
+long long* n_refs;
+char** names;
+int n_traces;
+{
+	static sweep_dim one_block, one_usize, one_isize, one_dsize, one_assoc, one_write, one_alloc;
+	Pcache_params cl = command_line();
+	sweep_dim* bs = swept(&spec->block_size, &one_block, cl->block_size);
+	sweep_dim* as = swept(&spec->assoc, &one_assoc, cl->assoc);
+	sweep_dim* wb = swept(&spec->writeback, &one_write, cl->writeback);
+	sweep_dim* wa = swept(&spec->writealloc, &one_alloc, cl->writealloc);
+	int split = spec->isize.n || spec->dsize.n || (!spec->usize.n && cl->split);
+	sweep_dim* us = split ? NULL : swept(&spec->usize, &one_usize, cl->usize);
+	sweep_dim* is = !split ? NULL : swept(&spec->isize, &one_isize, cl->isize);
+	sweep_dim* ds = !split ? NULL : swept(&spec->dsize, &one_dsize, cl->dsize);
+	int n_sizes = split ? is->n * ds->n : us->n;
+	int n_points = n_traces * bs->n * n_sizes * as->n * wb->n * wa->n;
+	Psweep_result* results = (Psweep_result*)calloc(n_points, sizeof(Psweep_result));
+	Psweep_result store = read_store(store_path);
+	char (*hashes)[17] = malloc(sizeof(*hashes) * n_traces);
+	int* point_trace = (int*)malloc(sizeof(int) * n_points);
+	int i, p, x, n_stored = 0, n_skipped = 0;
+	sim_config c;
+	Psweep_result r;
+	FILE* f;
+	for (i = 0; i < n_traces; i++)
+		trace_hash(refs[i], n_refs[i], hashes[i]);
+	config_params(&c, &sweep_params);
+
+	todo_configs = (sim_config*)malloc(sizeof(sim_config) * n_points);
+	todo_results = (Psweep_result*)malloc(sizeof(Psweep_result) * n_points);
+	n_todo = next_todo = 0;
+	sweep_refs = refs;
+	sweep_n_refs = n_refs;
+
+	for (p = 0; p < n_points; p++) {
+		// decompose the point index, the last parameter varies fastest
+		x = p;
+		c.writealloc = wa->value[x % wa->n]; x /= wa->n;
+		c.writeback = wb->value[x % wb->n]; x /= wb->n;
+		c.assoc = as->value[x % as->n]; x /= as->n;
+		if (split) {
+			c.usize = 0;
+			c.dsize = ds->value[x % ds->n]; x /= ds->n;
+			c.isize = is->value[x % is->n]; x /= is->n;
+		}
+		else {
+			c.usize = us->value[x % us->n]; x /= us->n;
+			c.isize = c.dsize = 0;
+		}
+		c.block_size = bs->value[x % bs->n]; x /= bs->n;
+		c.trace = 0;
+		point_trace[p] = x;
+
+		if (check_config(&c)) {
+			n_skipped++;
+			continue;
+		}
+		for (r = store; r; r = r->next)
+			if (!strcmp(r->hash, hashes[x]) && !memcmp(&r->config, &c, sizeof(sim_config)))
+				break;
+		if (r) {
+			results[p] = r;
+			n_stored++;
+			continue;
+		}
+
+		r = results[p] = (Psweep_result)calloc(1, sizeof(sweep_result));
+		strcpy(r->hash, hashes[x]);
+		r->config = c;
+		todo_results[n_todo] = r;
+		todo_configs[n_todo] = c;
+		todo_configs[n_todo].trace = x;
+		n_todo++;
+	}
+
+#ifdef _WIN32
+	sweep_worker(NULL);
+#else
+	{
+		pthread_t* threads;
+
+		if (workers < 1)
+			workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (workers > n_todo)
+			workers = n_todo;
+		threads = (pthread_t*)malloc(sizeof(pthread_t) * workers);
+		for (i = 0; i < workers; i++)
+			pthread_create(&threads[i], NULL, sweep_worker, NULL);
+		for (i = 0; i < workers; i++)
+			pthread_join(threads[i], NULL);
+		free(threads);
+	}
+#endif
+
+	// the store only grows, new results go at its end
+	if (store_path && n_todo) {
+		f = fopen(store_path, "r");
+		if (f)
+			fclose(f);
+		else if ((f = fopen(store_path, "w")) != NULL) {
+			fprintf(f, "trace_hash,bs,us,is,ds,a,wb,wa,hash,ss,mshr,lat,wbuf,wbd,wbraw,inst_accesses,inst_misses,inst_replace,"
+					"data_accesses,data_misses,data_replace,demand_fetch,copies_back,trace\n");
+			fclose(f);
+		}
+		f = fopen(store_path, "a");
+		if (!f) {
+			printf("error:  cannot write results store %s\n", store_path);
+			exit(-1);
+		}
+		for (i = 0; i < n_todo; i++)
+			write_store_row(f, todo_results[i], names[todo_configs[i].trace]);
+		fclose(f);
+	}
+
+	printf("\n*** SWEEP ***\n");
+	printf("  points:    %d\n", n_points);
+	printf("  stored:    %d\n", n_stored);
+	printf("  simulated: %d\n", n_todo);
+	if (n_skipped)
+		printf("  skipped:   %d (not a valid cache configuration)\n", n_skipped);
+
+	f = export_path ? fopen(export_path, "w") : stdout;
+	if (!f) {
+		printf("error:  cannot create %s\n", export_path);
+		exit(-1);
+	}
+	if (!export_path)
+		printf("\n");
+	fprintf(f, "trace,bs,us,is,ds,a,wb,wa,inst_accesses,inst_misses,inst_miss_rate,"
+			"data_accesses,data_misses,data_miss_rate,demand_fetch,copies_back\n");
+	for (p = 0; p < n_points; p++) {
+		if (!(r = results[p]))
+			continue;
+		c = r->config;
+		fprintf(f, "%s,%d,%d,%d,%d,%d,%d,%d,%lld,%lld,%.4f,%lld,%lld,%.4f,%lld,%lld\n", names[point_trace[p]],
+				c.block_size, c.usize, c.isize, c.dsize, c.assoc, c.writeback, c.writealloc,
+				r->inst.accesses, r->inst.misses,
+				r->inst.accesses ? (float)r->inst.misses / (float)r->inst.accesses : 0.0,
+				r->data.accesses, r->data.misses,
+				r->data.accesses ? (float)r->data.misses / (float)r->data.accesses : 0.0,
+				r->inst.demand_fetches + r->data.demand_fetches,
+				r->inst.copies_back + r->data.copies_back);
+	}
+	if (export_path)
+		fclose(f);
+}
+/************************************************************/
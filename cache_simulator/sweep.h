@@ -0,0 +1,39 @@
+/*
+ * sweep.h
+ */
+
+
+#define SWEEP_MAX_VALUES 64		/* values of one swept parameter */
+#define SWEEP_MAX_TRACES 64
+#define SWEEP_LINE_SIZE 1024
+
+/* structure definitions */
+typedef struct sweep_dim_ {
+  int n;
+  int value[SWEEP_MAX_VALUES];
+} sweep_dim;
+
+typedef struct sweep_spec_ {
+  char* traces[SWEEP_MAX_TRACES];
+  int n_traces;
+  sweep_dim block_size;
+  sweep_dim usize;
+  sweep_dim isize;
+  sweep_dim dsize;
+  sweep_dim assoc;
+  sweep_dim writeback;
+  sweep_dim writealloc;
+} sweep_spec, *Psweep_spec;
+
+typedef struct sweep_result_ {
+  char hash[17];		/* content hash of the trace, in hex */
+  sim_config config;		/* with trace 0, the hash names the trace */
+  cache_stat inst;
+  cache_stat data;
+  struct sweep_result_* next;
+} sweep_result, *Psweep_result;
+
+
+/* function prototypes */
+void read_sweep_spec();
+void run_sweep();
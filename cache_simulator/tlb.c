@@ -0,0 +1,363 @@
+/*
+ * tlb.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "cache.h"
+#include "main.h"
+#include "tlb.h"
+
+/* translation configuration parameters */
+static int tlb_enable = 0;
+static int tlb_entries = DEFAULT_TLB_ENTRIES;
+static int tlb_assoc = DEFAULT_TLB_ASSOC;
+static int stlb_entries = DEFAULT_STLB_ENTRIES;
+static int stlb_assoc = DEFAULT_STLB_ASSOC;
+static int page_size = DEFAULT_PAGE_SIZE;
+static int page_bits;
+static int walk_latency = DEFAULT_WALK_LATENCY;
+static int map_policy = PAGE_MAP_SEQUENTIAL;
+
+/* translation model data structures */
+static tlb itlb;
+static tlb dtlb;
+static tlb stlb;
+static unsigned long long tlb_clock;
+static int tlb_asid;			/* address space of the current trace */
+
+/* page table, an open addressing hash from vpn to pfn */
+static Ppage_map_entry page_map;
+static int page_map_size;
+static int pages_mapped;
+static unsigned next_frame;
+static unsigned n_frames;
+static unsigned page_colors;
+static unsigned *color_next;
+
+/* page walk statistics */
+static long long page_walks;
+static double walk_cycles;
+
+/************************************************************/
+/* initialize one TLB instance */
+void init_tlb_instance(Ptlb t, int entries, int assoc)
+{
+	t->entries = entries;
+	t->associativity = assoc;
+	t->n_sets = entries / assoc;
+	t->entry = (Ptlb_entry)malloc(sizeof(tlb_entry) * entries);
+	memset(t->entry, 0, sizeof(tlb_entry) * entries);
+	memset(&t->stat, 0, sizeof(tlb_stat));
+}
+/************************************************************/
+
+/************************************************************/
+/* initialize the TLBs and the page table */
+void init_tlb()
+{
+	unsigned i;
+
+	if (!tlb_enable)
+		return;
+
+	// checked once all the flags are in, so their order does not matter
+	if (tlb_entries < 1 || tlb_assoc < 1 || tlb_entries % tlb_assoc ||
+		stlb_entries < 0 || stlb_assoc < 1 || stlb_entries % stlb_assoc)
+	{
+		printf("error init_tlb: TLB entries must be a multiple of the associativity\n");
+		exit(-1);
+	}
+
+	page_bits = LOG2(page_size);
+	init_tlb_instance(&itlb, tlb_entries, tlb_assoc);
+	init_tlb_instance(&dtlb, tlb_entries, tlb_assoc);
+	if (stlb_entries)
+		init_tlb_instance(&stlb, stlb_entries, stlb_assoc);
+	tlb_clock = 0;
+
+	page_map_size = 1024;
+	page_map = (Ppage_map_entry)malloc(sizeof(page_map_entry) * page_map_size);
+	memset(page_map, 0, sizeof(page_map_entry) * page_map_size);
+	pages_mapped = 0;
+	next_frame = 0;
+	n_frames = 1u << (PHYS_ADDR_BITS - page_bits);
+
+	// a page color is a page-sized slice of the largest cache way.
+	page_colors = cache_way_size() / page_size;
+	if (page_colors < 1)
+		page_colors = 1;
+	if (page_colors > n_frames)
+		page_colors = n_frames;
+	color_next = (unsigned *)malloc(sizeof(unsigned) * page_colors);
+	for (i = 0; i < page_colors; i++)
+		color_next[i] = i;
+
+	page_walks = 0;
+	walk_cycles = 0;
+}
+/************************************************************/
+
+/************************************************************/
+/* look up a vpn, filling the LRU entry of its set on a miss */
+int tlb_lookup(Ptlb t, unsigned vpn)
+{
+	Ptlb_entry set = &t->entry[(vpn % t->n_sets) * t->associativity];
+	Ptlb_entry victim = set;
+	int i;
+
+	t->stat.accesses++;
+	tlb_clock++;
+
+	for (i = 0; i < t->associativity; i++)
+	{
+		if (set[i].valid && set[i].vpn == vpn && set[i].asid == tlb_asid)
+		{
+			set[i].lru = tlb_clock;
+			return TRUE;
+		}
+		if (!set[i].valid || (victim->valid && set[i].lru < victim->lru))
+			victim = &set[i];
+	}
+
+	t->stat.misses++;
+	victim->vpn = vpn;
+	victim->asid = tlb_asid;
+	victim->valid = TRUE;
+	victim->lru = tlb_clock;
+	return FALSE;
+}
+/************************************************************/
+
+/************************************************************/
+/* pick the frame for a newly touched page. Running out of frames is an
+   error, wrapping around would alias pages onto the same frame. */
+unsigned allocate_frame(unsigned vpn)
+{
+	unsigned frame, color, mask;
+
+	if (map_policy != PAGE_MAP_COLORING && next_frame == n_frames)
+	{
+		printf("error:  the traces touch more than the %u frames of %d-bit physical memory\n",
+			   n_frames, PHYS_ADDR_BITS);
+		exit(-1);
+	}
+
+	switch (map_policy)
+	{
+	case PAGE_MAP_RANDOM:
+		// scramble the allocation order through a bijection on the frame
+		// number space so frames never collide.
+		mask = n_frames - 1;
+		frame = next_frame++;
+		frame = (frame * 2654435761u) & mask;
+		frame ^= frame >> (PHYS_ADDR_BITS - page_bits) / 2;
+		frame = (frame * 0x9E3779B1u) & mask;
+		return frame;
+
+	case PAGE_MAP_COLORING:
+		// keep the virtual page color so the cache index bits above the
+		// page offset are the same in the virtual and physical address.
+		color = vpn % page_colors;
+		frame = color_next[color];
+		if (frame >= n_frames)
+		{
+			printf("error:  the traces touch more than the %u frames of page color %u\n",
+				   n_frames / page_colors, color);
+			exit(-1);
+		}
+		color_next[color] += page_colors;
+		return frame;
+
+	default:
+		return next_frame++;
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* find the frame of a page, mapping it on first touch */
+unsigned page_map_lookup(unsigned vpn)
+{
+	Ppage_map_entry old;
+	int old_size, i;
+	unsigned h;
+
+	if (pages_mapped * 2 >= page_map_size)
+	{
+		old = page_map;
+		old_size = page_map_size;
+		page_map_size *= 2;
+		page_map = (Ppage_map_entry)malloc(sizeof(page_map_entry) * page_map_size);
+		memset(page_map, 0, sizeof(page_map_entry) * page_map_size);
+		for (i = 0; i < old_size; i++)
+		{
+			if (!old[i].valid)
+				continue;
+			h = ((old[i].vpn ^ (old[i].asid << 20)) * 2654435761u) & (page_map_size - 1);
+			while (page_map[h].valid)
+				h = (h + 1) & (page_map_size - 1);
+			page_map[h] = old[i];
+		}
+		free(old);
+	}
+
+	h = ((vpn ^ (tlb_asid << 20)) * 2654435761u) & (page_map_size - 1);
+	while (page_map[h].valid)
+	{
+		if (page_map[h].vpn == vpn && page_map[h].asid == tlb_asid)
+			return page_map[h].pfn;
+		h = (h + 1) & (page_map_size - 1);
+	}
+
+	page_map[h].vpn = vpn;
+	page_map[h].asid = tlb_asid;
+	page_map[h].pfn = allocate_frame(vpn);
+	page_map[h].valid = TRUE;
+	pages_mapped++;
+	return page_map[h].pfn;
+}
+/************************************************************/
+
+/************************************************************/
+/* translate a virtual trace address to a physical address */
+unsigned translate(addr, access_type)
+unsigned addr, access_type;
+{
+	unsigned vpn = addr >> page_bits;
+	unsigned offset = addr & (page_size - 1);
+	Ptlb t = (access_type == TRACE_INST_LOAD) ? &itlb : &dtlb;
+
+	if (!tlb_lookup(t, vpn) && !(stlb_entries && tlb_lookup(&stlb, vpn)))
+	{
+		// x86-64 style radix walk: a level less for each huge page size.
+		page_walks++;
+		walk_cycles += walk_latency * (4 - (page_bits - 12) / 9);
+	}
+
+	return (page_map_lookup(vpn) << page_bits) | offset;
+}
+/************************************************************/
+
+/************************************************************/
+/* the co-running trace whose addresses are translated next */
+void set_tlb_asid(asid)
+int asid;
+{
+	tlb_asid = asid;
+}
+/************************************************************/
+
+/************************************************************/
+int tlb_enabled()
+{
+	return tlb_enable;
+}
+/************************************************************/
+
+/************************************************************/
+void set_tlb_param(param, value) int param;
+int value;
+{
+	switch (param)
+	{
+	case TLB_PARAM_ENTRIES:
+		tlb_enable = 1;
+		tlb_entries = value;
+		break;
+	case TLB_PARAM_ASSOC:
+		tlb_assoc = value;
+		break;
+	case TLB_PARAM_STLB_ENTRIES:
+		tlb_enable = 1;
+		stlb_entries = value;
+		break;
+	case TLB_PARAM_STLB_ASSOC:
+		stlb_assoc = value;
+		break;
+	case TLB_PARAM_PAGE_SIZE:
+		if (value != 4 * 1024 && value != 2 * 1024 * 1024 && value != 1024 * 1024 * 1024)
+		{
+			printf("error set_tlb_param: page size must be 4K, 2M or 1G\n");
+			exit(-1);
+		}
+		tlb_enable = 1;
+		page_size = value;
+		break;
+	case TLB_PARAM_WALK_LATENCY:
+		if (value < 0)
+		{
+			printf("error set_tlb_param: page walk latency must not be negative\n");
+			exit(-1);
+		}
+		walk_latency = value;
+		break;
+	case TLB_PARAM_MAP_POLICY:
+		tlb_enable = 1;
+		map_policy = value;
+		break;
+	default:
+		printf("error set_tlb_param: bad parameter value\n");
+		exit(-1);
+	}
+}
+/************************************************************/
+
+/************************************************************/
+void dump_tlb_settings()
+{
+	static const char *policy[] = { "SEQUENTIAL", "RANDOM", "COLORING" };
+
+	if (!tlb_enable)
+		return;
+
+	printf("  TLB entries: \t%d\n", tlb_entries);
+	printf("  TLB associativity: \t%d\n", tlb_assoc);
+	if (stlb_entries)
+	{
+		printf("  STLB entries: \t%d\n", stlb_entries);
+		printf("  STLB associativity: \t%d\n", stlb_assoc);
+	}
+	printf("  Page size: \t%d\n", page_size);
+	printf("  Page walk latency: \t%d\n", walk_latency);
+	printf("  Page mapping: \t%s\n", policy[map_policy]);
+}
+/************************************************************/
+
+/************************************************************/
+void print_tlb_instance(name, t)
+char *name;
+Ptlb t;
+{
+	printf(" %s\n", name);
+	printf("  accesses:  %lld\n", t->stat.accesses);
+	printf("  misses:    %lld\n", t->stat.misses);
+	if (!t->stat.accesses)
+		printf("  miss rate: 0 (0)\n");
+	else
+		printf("  miss rate: %2.4f (hit rate %2.4f)\n",
+			   (float)t->stat.misses / (float)t->stat.accesses,
+			   1.0 - (float)t->stat.misses / (float)t->stat.accesses);
+}
+/************************************************************/
+
+/************************************************************/
+void print_tlb_stats()
+{
+	if (!tlb_enable)
+		return;
+
+	printf("\n*** TLB STATISTICS ***\n");
+	print_tlb_instance("I-TLB", &itlb);
+	print_tlb_instance("D-TLB", &dtlb);
+	if (stlb_entries)
+		print_tlb_instance("STLB", &stlb);
+	printf(" PAGE WALKS\n");
+	printf("  walks:         %lld\n", page_walks);
+	printf("  walk cycles:   %.0f\n", walk_cycles);
+	printf("  pages mapped:  %d\n", pages_mapped);
+}
+/************************************************************/
@@ -0,0 +1,66 @@
+/*
+ * tlb.h
+ */
+
+
+/* default translation parameters--can be changed */
+#define DEFAULT_TLB_ENTRIES 64
+#define DEFAULT_TLB_ASSOC 4
+#define DEFAULT_STLB_ENTRIES 0		/* 0 = no second level TLB */
+#define DEFAULT_STLB_ASSOC 8
+#define DEFAULT_PAGE_SIZE (4 * 1024)
+#define DEFAULT_WALK_LATENCY 20		/* cycles per page table level */
+#define PHYS_ADDR_BITS 32
+
+/* page mapping policies */
+#define PAGE_MAP_SEQUENTIAL 0
+#define PAGE_MAP_RANDOM 1
+#define PAGE_MAP_COLORING 2
+
+/* constants for settting translation parameters */
+#define TLB_PARAM_ENTRIES 0
+#define TLB_PARAM_ASSOC 1
+#define TLB_PARAM_STLB_ENTRIES 2
+#define TLB_PARAM_STLB_ASSOC 3
+#define TLB_PARAM_PAGE_SIZE 4
+#define TLB_PARAM_WALK_LATENCY 5
+#define TLB_PARAM_MAP_POLICY 6
+
+
+/* structure definitions */
+typedef struct tlb_entry_ {
+  unsigned vpn;			/* virtual page number */
+  unsigned long long lru;	/* last use, larger is more recent */
+  int asid;			/* address space, one per trace */
+  int valid;
+} tlb_entry, *Ptlb_entry;
+
+typedef struct tlb_stat_ {
+  long long accesses;		/* number of lookups */
+  long long misses;		/* number of lookups that missed */
+} tlb_stat, *Ptlb_stat;
+
+typedef struct tlb_ {
+  int entries;			/* number of entries */
+  int associativity;		/* entries per set */
+  int n_sets;			/* number of sets */
+  Ptlb_entry entry;		/* n_sets * associativity entries */
+  tlb_stat stat;
+} tlb, *Ptlb;
+
+typedef struct page_map_entry_ {
+  unsigned vpn;
+  unsigned pfn;
+  int asid;
+  int valid;
+} page_map_entry, *Ppage_map_entry;
+
+
+/* function prototypes */
+void set_tlb_param();
+void init_tlb();
+unsigned translate();
+void dump_tlb_settings();
+void print_tlb_stats();
+int tlb_enabled();
+void set_tlb_asid();
@@ -0,0 +1,599 @@
+/*
+ * trace.c
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#endif
+
+#include "cache.h"
+#include "trace.h"
+
+#ifndef _WIN32
+/* an ASCII trace, parsed chunk by chunk by other threads. A mapped file
+   is split up front and parsed by a pool of workers, a pipe or terminal
+   is read and parsed by a single thread as the data arrives. */
+struct text_trace_ {
+  const char* text;		/* mapped file, NULL for a stream */
+  size_t size;
+  FILE* stream;
+  int n_chunks;			/* -1 until a stream reaches its end */
+  size_t* chunk_start;		/* chunk k is [chunk_start[k], chunk_start[k+1]) */
+
+  /* parsed chunks waiting for the simulator, chunk k in slot k % window */
+  Pparsed_ref* ring_refs;
+  int* ring_n;
+  int* ring_ready;
+
+  int next_chunk;		/* next chunk a worker parses */
+  int consume_chunk;		/* next chunk the simulator takes */
+  int window;			/* chunks parsed ahead of the simulator */
+  int stopping;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;		/* a chunk has been parsed */
+  pthread_cond_t space;		/* the simulator has taken a chunk */
+  int n_workers;
+  pthread_t* workers;
+
+  Pparsed_ref refs;		/* chunk being consumed */
+  int n, pos;
+};
+#endif
+
+/* value of each hex digit, 0xFF for other characters */
+static unsigned char hex_value[256];
+
+/* the derived trace of the references leaving the cache */
+static FILE* miss_trace;
+static char* miss_trace_name;
+static unsigned long long miss_trace_records;
+
+/************************************************************/
+/* start writing the miss and writeback stream to a binary trace */
+int open_miss_trace(name)
+char* name;
+{
+	unsigned char header[BINARY_TRACE_HEADER];
+
+	miss_trace = fopen(name, "wb");
+	if (!miss_trace)
+		return 0;
+	setvbuf(miss_trace, NULL, _IOFBF, 1 << 16);
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, BINARY_TRACE_MAGIC, 4);
+	header[4] = BINARY_TRACE_VERSION;
+	fwrite(header, 1, sizeof(header), miss_trace);
+
+	miss_trace_name = name;
+	miss_trace_records = 0;
+	return 1;
+}
+/************************************************************/
+
+/************************************************************/
+/* append one reference to the derived trace */
+void emit_reference(access_type, addr)
+unsigned access_type, addr;
+{
+	unsigned record = (addr & ~BINARY_TRACE_TYPE_MASK) | access_type;
+	unsigned char bytes[4];
+
+	bytes[0] = record;
+	bytes[1] = record >> 8;
+	bytes[2] = record >> 16;
+	bytes[3] = record >> 24;
+	fwrite(bytes, 1, 4, miss_trace);
+	miss_trace_records++;
+}
+/************************************************************/
+
+/************************************************************/
+void close_miss_trace()
+{
+	if (!miss_trace)
+		return;
+
+	fclose(miss_trace);
+	miss_trace = NULL;
+	printf("\n MISS TRACE\n");
+	printf("  records: %llu written to %s\n", miss_trace_records, miss_trace_name);
+}
+/************************************************************/
+
+/************************************************************/
+/* check for a binary trace header and skip it, an ASCII trace is left
+   untouched so this also works on streams that cannot seek */
+int is_binary_trace(inFile)
+FILE* inFile;
+{
+	unsigned char header[BINARY_TRACE_HEADER];
+	int c = getc(inFile);
+
+	if (c == EOF)
+		return 0;
+	ungetc(c, inFile);
+	if (c != (unsigned char)BINARY_TRACE_MAGIC[0])
+		return 0;
+
+	if (fread(header, 1, sizeof(header), inFile) != sizeof(header) ||
+		memcmp(header, BINARY_TRACE_MAGIC, 4))
+	{
+		printf("error:  corrupt binary trace header\n");
+		exit(-1);
+	}
+	if (header[4] != BINARY_TRACE_VERSION)
+	{
+		printf("error:  unsupported binary trace version %d\n", header[4]);
+		exit(-1);
+	}
+	return 1;
+}
+/************************************************************/
+
+/************************************************************/
+/* size in bytes of a trace file, or -1 for a pipe or terminal */
+long long trace_file_size(inFile)
+FILE* inFile;
+{
+#ifdef _WIN32
+	struct _stat64 st;
+
+	if (_fstat64(_fileno(inFile), &st) || !(st.st_mode & _S_IFREG))
+		return -1;
+#else
+	struct stat st;
+
+	if (fstat(fileno(inFile), &st) || !S_ISREG(st.st_mode))
+		return -1;
+#endif
+	return (long long)st.st_size;
+}
+
+/* bytes of a trace file read so far, t is its mapped text or NULL. A
+   mapped trace counts the chunks the simulator has taken. */
+long long trace_file_offset(inFile, t)
+FILE* inFile;
+Ptext_trace t;
+{
+#ifdef _WIN32
+	return _ftelli64(inFile);
+#else
+	if (t)
+		return t->text ? (long long)t->chunk_start[t->consume_chunk] : -1;
+	return (long long)ftello(inFile);
+#endif
+}
+/************************************************************/
+
+/************************************************************/
+int read_binary_element(inFile, access_type, addr)
+FILE* inFile;
+unsigned* access_type, * addr;
+{
+	unsigned char bytes[4];
+	unsigned record;
+
+	if (fread(bytes, 1, 4, inFile) != 4)
+		return 0;
+	record = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (unsigned)bytes[3] << 24;
+	*access_type = record & BINARY_TRACE_TYPE_MASK;
+	*addr = record & ~BINARY_TRACE_TYPE_MASK;
+	return 1;
+}
+/************************************************************/
+
+/************************************************************/
+/* fill the digit table, before any thread parses */
+void init_hex_value()
+{
+	int i;
+
+	if (hex_value['1'])
+		return;
+	memset(hex_value, 0xFF, sizeof(hex_value));
+	for (i = 0; i < 10; i++)
+		hex_value['0' + i] = i;
+	for (i = 0; i < 6; i++)
+		hex_value['a' + i] = hex_value['A' + i] = 10 + i;
+}
+/************************************************************/
+
+/************************************************************/
+/* parse the lines of text[0, len) the way read_trace_element does */
+static long long parse_chunk(text, len, refs)
+const char* text;
+size_t len;
+Pparsed_ref* refs;
+{
+	const unsigned char* p = (const unsigned char*)text;
+	const unsigned char* end = p + len;
+	Pparsed_ref r;
+	unsigned type, addr, d;
+	int cls;
+
+	// every reference but the last takes at least two characters, "2\n",
+	// as the address and class are optional
+	r = *refs = (Pparsed_ref)malloc(sizeof(parsed_ref) * (len / 2 + 1));
+	for (;;) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+			p++;
+		if (p == end)
+			break;
+
+		if (*p >= '0' && *p <= '9') {
+			for (type = 0; p < end && *p >= '0' && *p <= '9'; p++)
+				type = type * 10 + *p - '0';
+			while (p < end && (*p == ' ' || *p == '\t'))
+				p++;
+			if (end - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x' && hex_value[p[2]] < 16)
+				p += 2;
+			for (addr = 0; p < end && (d = hex_value[*p]) < 16; p++)
+				addr = addr << 4 | d;
+			while (p < end && (*p == ' ' || *p == '\t'))
+				p++;
+			cls = -1;
+			if (p < end && *p >= '0' && *p <= '9')
+				for (cls = 0; p < end && *p >= '0' && *p <= '9'; p++)
+					if (cls < MAX_CACHE_CLASSES)
+						cls = cls * 10 + *p - '0';
+			if (cls >= MAX_CACHE_CLASSES) {
+				printf("error:  trace classes must be 0..%d\n", MAX_CACHE_CLASSES - 1);
+				exit(-1);
+			}
+
+			r->addr = addr;
+			r->access_type = type;
+			r->cls = cls;
+			r++;
+		}
+
+		// the rest of the line is a comment
+		p = memchr(p, '\n', end - p);
+		if (!p)
+			break;
+	}
+	return r - *refs;
+}
+/************************************************************/
+
+#ifndef _WIN32
+/************************************************************/
+/* wait until chunk k has a free slot, FALSE when the trace is closed */
+static int wait_for_slot(t, k)
+Ptext_trace t;
+int k;
+{
+	int open;
+
+	pthread_mutex_lock(&t->lock);
+	while (!t->stopping && k >= t->consume_chunk + t->window)
+		pthread_cond_wait(&t->space, &t->lock);
+	open = !t->stopping;
+	pthread_mutex_unlock(&t->lock);
+	return open;
+}
+/************************************************************/
+
+/************************************************************/
+/* hand parsed chunk k to the simulator */
+static void publish_chunk(t, k, refs, n)
+Ptext_trace t;
+int k;
+Pparsed_ref refs;
+int n;
+{
+	pthread_mutex_lock(&t->lock);
+	t->ring_refs[k % t->window] = refs;
+	t->ring_n[k % t->window] = n;
+	t->ring_ready[k % t->window] = 1;
+	pthread_cond_broadcast(&t->ready);
+	pthread_mutex_unlock(&t->lock);
+}
+/************************************************************/
+
+/************************************************************/
+static void* parse_worker(arg)
+void* arg;
+{
+	Ptext_trace t = (Ptext_trace)arg;
+	Pparsed_ref refs;
+	int k, n;
+
+	for (;;) {
+		pthread_mutex_lock(&t->lock);
+		k = t->next_chunk++;
+		pthread_mutex_unlock(&t->lock);
+		if (k >= t->n_chunks || !wait_for_slot(t, k))
+			return NULL;
+
+		n = (int)parse_chunk(t->text + t->chunk_start[k], t->chunk_start[k + 1] - t->chunk_start[k], &refs);
+		publish_chunk(t, k, refs, n);
+	}
+}
+/************************************************************/
+
+/************************************************************/
+/* more of a stream can be read without blocking */
+static int data_waiting(fd)
+int fd;
+{
+	struct pollfd p;
+
+	p.fd = fd;
+	p.events = POLLIN;
+	return poll(&p, 1, 0) > 0;
+}
+
+/* read a pipe as its data arrives and parse the complete lines of each
+   read, so a slow tracer is simulated as it goes. The reader stops once
+   it is window chunks ahead, so a fast tracer blocks on the full pipe
+   instead of filling memory. */
+static void* stream_reader(arg)
+void* arg;
+{
+	Ptext_trace t = (Ptext_trace)arg;
+	size_t size = TRACE_BUFFER_SIZE, have, cut;
+	char* buf = (char*)malloc(size);
+	int fd = fileno(t->stream), flags = fcntl(fd, F_GETFL);
+	Pparsed_ref refs;
+	ssize_t got;
+	int k, n, eof = 0;
+
+	// take what stdio holds already without waiting for more, the rest
+	// is read past it
+	fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	have = fread(buf, 1, size, t->stream);
+	clearerr(t->stream);
+	fcntl(fd, F_SETFL, flags);
+
+	for (k = 0;; ) {
+		// parse up to the last line end, the rest waits for more data
+		for (cut = have; !eof && cut > 0 && buf[cut - 1] != '\n'; cut--)
+			;
+		if (cut > 0) {
+			if (!wait_for_slot(t, k))
+				break;
+			n = (int)parse_chunk(buf, cut, &refs);
+			publish_chunk(t, k++, refs, n);
+			memmove(buf, buf + cut, have - cut);
+			have -= cut;
+		}
+		if (eof)
+			break;
+
+		// wait for data only when none has arrived, and take what a fast
+		// tracer has written since, up to a block
+		do {
+			if (have == size)
+				buf = (char*)realloc(buf, size *= 2);
+			got = read(fd, buf + have, size - have);
+			if (got > 0)
+				have += got;
+			else if (got == 0 || errno != EINTR)
+				eof = 1;
+		} while (!eof && have < TRACE_BUFFER_SIZE && data_waiting(fd));
+	}
+
+	pthread_mutex_lock(&t->lock);
+	t->n_chunks = k;
+	pthread_cond_broadcast(&t->ready);
+	pthread_mutex_unlock(&t->lock);
+	free(buf);
+	return NULL;
+}
+/************************************************************/
+#endif
+
+/************************************************************/
+/* start parsing an ASCII trace with threads workers, or -1 for one per
+   processor. A regular file is mapped, anything else is streamed.
+   Returns NULL when threads is 0 or the file cannot be read this way,
+   the caller then reads it with read_trace_element. */
+Ptext_trace open_text_trace(inFile, threads)
+FILE* inFile;
+int threads;
+{
+#ifdef _WIN32
+	return NULL;
+#else
+	Ptext_trace t;
+	struct stat st;
+	void* text = NULL;
+	size_t at;
+	int i;
+
+	if (!threads || fstat(fileno(inFile), &st))
+		return NULL;
+	if (S_ISREG(st.st_mode)) {
+		// a 32 bit build cannot map more than its address space
+		if (st.st_size == 0 || (off_t)(size_t)st.st_size != st.st_size)
+			return NULL;
+		text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(inFile), 0);
+		if (text == MAP_FAILED)
+			return NULL;
+		madvise(text, st.st_size, MADV_SEQUENTIAL);
+	}
+
+	init_hex_value();
+	t = (Ptext_trace)calloc(1, sizeof(*t));
+	if (text) {
+		t->text = (const char*)text;
+		t->size = st.st_size;
+
+		// cut the text after the first line end past each chunk boundary
+		t->chunk_start = (size_t*)malloc(sizeof(size_t) * (t->size / TEXT_CHUNK_SIZE + 2));
+		t->chunk_start[0] = 0;
+		for (at = 0; at < t->size; ) {
+			const char* nl;
+
+			at = at + TEXT_CHUNK_SIZE < t->size ? at + TEXT_CHUNK_SIZE : t->size;
+			nl = memchr(t->text + at, '\n', t->size - at);
+			at = nl ? (size_t)(nl - t->text) + 1 : t->size;
+			t->chunk_start[++t->n_chunks] = at;
+		}
+
+		if (threads < 0)
+			threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		t->n_workers = threads < 1 ? 1 : threads < t->n_chunks ? threads : t->n_chunks;
+	}
+	else {
+		t->stream = inFile;
+		t->n_chunks = -1;
+		t->n_workers = 1;
+	}
+
+	t->window = t->n_workers * TEXT_CHUNK_WINDOW;
+	t->ring_refs = (Pparsed_ref*)calloc(t->window, sizeof(Pparsed_ref));
+	t->ring_n = (int*)calloc(t->window, sizeof(int));
+	t->ring_ready = (int*)calloc(t->window, sizeof(int));
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->ready, NULL);
+	pthread_cond_init(&t->space, NULL);
+	t->workers = (pthread_t*)malloc(sizeof(pthread_t) * t->n_workers);
+	for (i = 0; i < t->n_workers; i++)
+		pthread_create(&t->workers[i], NULL, text ? parse_worker : stream_reader, t);
+
+	return t;
+#endif
+}
+/************************************************************/
+
+/************************************************************/
+/* the next reference of the trace, in file order */
+int read_text_element(t, access_type, addr, cls)
+Ptext_trace t;
+unsigned* access_type, * addr;
+int* cls;
+{
+#ifndef _WIN32
+	Pparsed_ref r;
+	int slot;
+
+	while (t->pos == t->n) {
+		free(t->refs);
+		t->refs = NULL;
+		t->n = t->pos = 0;
+
+		// take the next chunk once it is parsed, and let the workers
+		// move on past it
+		pthread_mutex_lock(&t->lock);
+		slot = t->consume_chunk % t->window;
+		while (!t->ring_ready[slot] && (t->n_chunks < 0 || t->consume_chunk < t->n_chunks))
+			pthread_cond_wait(&t->ready, &t->lock);
+		if (!t->ring_ready[slot]) {
+			pthread_mutex_unlock(&t->lock);
+			return 0;
+		}
+		t->refs = t->ring_refs[slot];
+		t->n = t->ring_n[slot];
+		t->ring_ready[slot] = 0;
+		t->consume_chunk++;
+		pthread_cond_broadcast(&t->space);
+		pthread_mutex_unlock(&t->lock);
+	}
+
+	r = &t->refs[t->pos++];
+	*access_type = r->access_type;
+	*addr = r->addr;
+	*cls = r->cls;
+	return 1;
+#else
+	return 0;
+#endif
+}
+/************************************************************/
+
+/************************************************************/
+void close_text_trace(t)
+Ptext_trace t;
+{
+#ifndef _WIN32
+	int i;
+
+	// stop the workers, even if the trace was not read to the end
+	pthread_mutex_lock(&t->lock);
+	t->stopping = 1;
+	pthread_cond_broadcast(&t->space);
+	pthread_mutex_unlock(&t->lock);
+	for (i = 0; i < t->n_workers; i++)
+		pthread_join(t->workers[i], NULL);
+
+	for (i = 0; i < t->window; i++)
+		if (t->ring_ready[i])
+			free(t->ring_refs[i]);
+	free(t->refs);
+	free(t->ring_refs);
+	free(t->ring_n);
+	free(t->ring_ready);
+	free(t->chunk_start);
+	free(t->workers);
+	if (t->text)
+		munmap((void*)t->text, t->size);
+	free(t);
+#endif
+}
+/************************************************************/
+
+/************************************************************/
+/* read a whole trace file, ASCII or binary, into memory without
+   touching any shared state, so threads can load traces at once.
+   Returns the number of references, or -1 if the file cannot be read
+   or does not fit in memory. */
+long long load_trace_file(name, refs)
+char* name;
+Pparsed_ref* refs;
+{
+	FILE* f = fopen(name, "rb");
+	unsigned char* buf;
+	size_t size = TRACE_BUFFER_SIZE, have = 0, got;
+	unsigned record;
+	long long n, i;
+
+	if (!f)
+		return -1;
+	buf = (unsigned char*)malloc(size);
+	while ((got = fread(buf + have, 1, size - have, f)) > 0) {
+		have += got;
+		if (have == size) {
+			unsigned char* grown = (unsigned char*)realloc(buf, size *= 2);
+
+			if (!grown) {
+				free(buf);
+				fclose(f);
+				return -1;
+			}
+			buf = grown;
+		}
+	}
+	fclose(f);
+
+	if (have >= BINARY_TRACE_HEADER && !memcmp(buf, BINARY_TRACE_MAGIC, 4)) {
+		n = (long long)((have - BINARY_TRACE_HEADER) / 4);
+		*refs = (Pparsed_ref)malloc(sizeof(parsed_ref) * (n + 1));
+		for (i = 0; i < n; i++) {
+			unsigned char* b = buf + BINARY_TRACE_HEADER + 4 * i;
+			record = b[0] | b[1] << 8 | b[2] << 16 | (unsigned)b[3] << 24;
+			(*refs)[i].addr = record & ~BINARY_TRACE_TYPE_MASK;
+			(*refs)[i].access_type = record & BINARY_TRACE_TYPE_MASK;
+			(*refs)[i].cls = -1;
+		}
+	}
+	else {
+		init_hex_value();
+		n = parse_chunk((char*)buf, have, refs);
+	}
+	free(buf);
+	return n;
+}
+/************************************************************/
@@ -0,0 +1,43 @@
+/*
+ * trace.h
+ */
+
+
+/* binary traces start with a header of magic, version and 3 reserved
+   bytes, then one little-endian 32 bit record per reference holding the
+   word aligned address with the access type in its low two bits */
+#define BINARY_TRACE_MAGIC "\x89MTR"
+#define BINARY_TRACE_VERSION 1
+#define BINARY_TRACE_HEADER 8
+#define BINARY_TRACE_TYPE_MASK 3
+
+/* ASCII traces are mapped and parsed in chunks of about this many bytes,
+   cut at line ends, by a pool of threads while the simulator consumes the
+   chunks in order */
+#define TEXT_CHUNK_SIZE (4 * 1024 * 1024)
+#define TEXT_CHUNK_WINDOW 2		/* chunks parsed ahead per thread */
+#define TRACE_BUFFER_SIZE (1024 * 1024)	/* read size of traces that are not mapped */
+
+/* structure definitions */
+typedef struct parsed_ref_ {
+  unsigned addr;
+  unsigned short access_type;
+  short cls;			/* class field of the line, -1 if none */
+} parsed_ref, *Pparsed_ref;
+
+typedef struct text_trace_ *Ptext_trace;	/* defined in trace.c */
+
+
+/* function prototypes */
+int open_miss_trace();
+void emit_reference();
+void close_miss_trace();
+int is_binary_trace();
+int read_binary_element();
+long long trace_file_size();
+long long trace_file_offset();
+Ptext_trace open_text_trace();
+int read_text_element();
+void close_text_trace();
+void init_hex_value();
+long long load_trace_file();